@@ -0,0 +1,108 @@
+/****************************************************/
+/* File: arena.c                                    */
+/* Bump-pointer arena allocator for the C- compiler */
+/****************************************************/
+
+#include "arena.h"
+#include <stddef.h>
+
+/* ARENABLOCK = size of the blocks objects are
+   carved from; larger objects get a block each */
+#define ARENABLOCK 65536
+
+/* ARENAALIGN = alignment of every object */
+#define ARENAALIGN sizeof(union { void *p; double d; long long l; })
+
+struct arenaBlock
+{
+  ArenaBlock *next;
+  /* keeps the first object aligned */
+  union { void *p; double d; long long l; } data[1];
+};
+
+/* newBlock adds a block of n bytes to a, behind
+   the current one if keep is set */
+static char *newBlock(Arena *a, size_t n, int keep)
+{
+  ArenaBlock *b = (ArenaBlock *)malloc(offsetof(ArenaBlock, data) + n);
+  if (b == NULL)
+    return NULL;
+  if (keep)
+  {
+    b->next = a->blocks->next;
+    a->blocks->next = b;
+  }
+  else
+  {
+    b->next = a->blocks;
+    a->blocks = b;
+    a->free = (char *)b->data;
+    a->end = a->free + n;
+  }
+  return (char *)b->data;
+}
+
+void *arenaAlloc(Arena *a, size_t size)
+{
+  char *t;
+  size = (size + ARENAALIGN - 1) & ~(ARENAALIGN - 1);
+  if ((size_t)(a->end - a->free) < size)
+  {
+    /* large objects get a block of their own, so the
+       space left in the current block is not lost.
+       With no current block one is made big enough
+       for the object, which is carved from it */
+    if (size > ARENABLOCK / 4 && a->blocks != NULL)
+      return newBlock(a, size, TRUE);
+    if (newBlock(a, size > ARENABLOCK ? size : ARENABLOCK, FALSE) == NULL)
+      return NULL;
+  }
+  t = a->free;
+  a->free += size;
+  return t;
+}
+
+void arenaRelease(Arena *a)
+{
+  while (a->blocks != NULL)
+  {
+    ArenaBlock *next = a->blocks->next;
+    free(a->blocks);
+    a->blocks = next;
+  }
+  a->free = a->end = NULL;
+}
+
+void arenaReset(Arena *a)
+{
+  ArenaBlock *keep = a->blocks;
+  char *end = a->end;
+  if (keep == NULL)
+    return;
+  a->blocks = keep->next;
+  arenaRelease(a);
+  keep->next = NULL;
+  a->blocks = keep;
+  a->free = (char *)keep->data;
+  a->end = end;
+}
+
+/* the blocks of from go behind the current block of
+   into, which keeps handing out its free space */
+void arenaAdopt(Arena *into, Arena *from)
+{
+  ArenaBlock *b;
+  if (from->blocks == NULL)
+    return;
+  if (into->blocks == NULL)
+    *into = *from;
+  else
+  {
+    for (b = from->blocks; b->next != NULL; b = b->next)
+      ;
+    b->next = into->blocks->next;
+    into->blocks->next = from->blocks;
+  }
+  from->blocks = NULL;
+  from->free = from->end = NULL;
+}
@@ -0,0 +1,44 @@
+/****************************************************/
+/* File: arena.h                                    */
+/* Bump-pointer arena allocator for the C- compiler */
+/****************************************************/
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+#include "globals.h"
+
+/* an Arena hands out memory carved from large
+ * blocks; nothing is freed one object at a time,
+ * arenaRelease frees the whole arena at once.
+ * A zeroed Arena is an empty one
+ */
+typedef struct arenaBlock ArenaBlock;
+
+typedef struct arena
+{
+  ArenaBlock *blocks; /* most recent block first */
+  char *free;         /* next free byte of blocks */
+  char *end;          /* one past the last byte */
+} Arena;
+
+/* Function arenaAlloc returns size bytes of a,
+ * aligned for any object; NULL if out of memory
+ */
+void *arenaAlloc(Arena *a, size_t size);
+
+/* Procedure arenaRelease frees everything
+ * allocated from a, leaving it empty
+ */
+void arenaRelease(Arena *a);
+
+/* Procedure arenaReset empties a like arenaRelease
+ * but keeps its current block for the next objects
+ */
+void arenaReset(Arena *a);
+
+/* Procedure arenaAdopt moves everything allocated
+ * from from into into, leaving from empty
+ */
+void arenaAdopt(Arena *into, Arena *from);
+
+#endif
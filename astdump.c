@@ -0,0 +1,97 @@
+/****************************************************/
+/* File: astdump.c                                  */
+/* Reads an AST file written by --ast: prints the   */
+/* syntax tree as the compiler lists it, or alone   */
+/* as JSON or S-expressions with --format, or with  */
+/* --stats walks the mapped nodes in place and      */
+/* counts them                                      */
+/****************************************************/
+
+#include "cminus.h"
+
+/* tally counts the nodes of the list starting at
+   node n and below it, by kind, in place */
+static void tally(const AstFile *af, int n, int depth, long counts[3][8], int *maxDepth)
+{
+  for (; n != NONODE; n = af->nodes[n].next)
+  {
+    const AstNode *f = &af->nodes[n];
+    int k;
+    counts[f->nodekind][f->kind]++;
+    if (depth > *maxDepth)
+      *maxDepth = depth;
+    for (k = 0; k < f->nkids; k++)
+      tally(af, ASTKID(af, n, k), depth + 1, counts, maxDepth);
+  }
+}
+
+static void printStats(const AstFile *af)
+{
+  static const char *dclr[] = {"variables", "arrays", "functions"};
+  static const char *stmt[] = {"assignments", "compound", "if", "while", "return"};
+  static const char *exp[] = {"operators", "constants", "subscripts", "calls", "ids"};
+  long counts[3][8];
+  int i, n, maxDepth = 0, functions = 0;
+  memset(counts, 0, sizeof(counts));
+  tally(af, af->header->root, 1, counts, &maxDepth);
+  printf("%u nodes, %u names, depth %d\n", af->header->nodeCount, af->header->nameCount, maxDepth);
+  for (i = 0; i < 3; i++)
+    printf("  %-12s %ld\n", dclr[i], counts[DclrK][i]);
+  for (i = 0; i < 5; i++)
+    printf("  %-12s %ld\n", stmt[i], counts[StmtK][i]);
+  for (i = 0; i < 5; i++)
+    printf("  %-12s %ld\n", exp[i], counts[ExpK][i]);
+  /* the first few functions, by name */
+  for (n = af->header->root; n != NONODE && functions < 5; n = af->nodes[n].next)
+    if (af->nodes[n].nodekind == DclrK && af->nodes[n].kind == FunK)
+    {
+      printf("  function %s, line %d\n", af->nodes[n].attr != NOSYMBOL ? ASTNAME(af, af->nodes[n].attr) : "(null)",
+             af->nodes[n].lineno);
+      functions++;
+    }
+}
+
+/* printListing prints the tree as printTree would,
+   or in format alone */
+static void printListing(const AstFile *af, TreeFormat format)
+{
+  TreeWriter w;
+  CompileContext *cx = newCompileContext(NULL, stdout);
+  FlatTree ft;
+  int i;
+  if (cx == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  for (i = 0; i < (int)af->header->nameCount; i++)
+    internName(cx->symbols, ASTNAME(af, i), strlen(ASTNAME(af, i)));
+  viewAstFile(af, &ft);
+  if (format == TextTree)
+    printf("\nSyntax tree:\n");
+  startTreeWriter(&w, stdout, format, cx->symbols);
+  writeFlatTree(&w, &ft);
+  endTreeWriter(&w);
+  freeCompileContext(cx);
+}
+
+int main(int argc, char *argv[])
+{
+  AstFile af;
+  TreeFormat format = TextTree;
+  int stats = argc == 3 && strcmp(argv[1], "--stats") == 0;
+  int formatted = argc == 4 && strcmp(argv[1], "--format") == 0 && treeFormatOf(argv[2], &format);
+  if (argc != 2 + stats + 2 * formatted)
+  {
+    fprintf(stderr, "usage: %s [--stats | --format text | json | sexp] <file.ast>\n", argv[0]);
+    exit(1);
+  }
+  if (!openAstFile(argv[argc - 1], &af))
+    exit(1);
+  if (stats)
+    printStats(&af);
+  else
+    printListing(&af, format);
+  closeAstFile(&af);
+  return 0;
+}
@@ -0,0 +1,227 @@
+/****************************************************/
+/* File: astfile.c                                  */
+/* Binary syntax tree files: a FlatTree and its     */
+/* names laid out to be mapped and read in place    */
+/****************************************************/
+
+#include "astfile.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* the node and array sections are the FlatTree's
+   own arrays, written as they are */
+typedef char nodeLayoutMatches[(sizeof(AstNode) == sizeof(FlatNode) &&
+                                offsetof(AstNode, kids) == offsetof(FlatNode, kids)) ? 1 : -1];
+typedef char arrayLayoutMatches[(sizeof(AstArray) == sizeof(Array)) ? 1 : -1];
+
+int writeAstFile(const char *path, const FlatTree *ft, const InternTable *symbols)
+{
+  AstHeader h;
+  unsigned long long size;
+  uint32_t offset;
+  int i, ok;
+  FILE *f;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, ASTMAGIC, 4);
+  h.byteOrder = ASTBYTEORDER;
+  h.version = ASTVERSION;
+  h.headerSize = sizeof(h);
+  h.root = ft->root;
+  h.nodeCount = ft->count;
+  h.kidCount = ft->kidCount;
+  h.arrayCount = ft->arrayCount;
+  h.nameCount = symbolCount(symbols);
+  for (i = 0; i < (int)h.nameCount; i++)
+    h.nameBytes += strlen(symbolName(symbols, i)) + 1;
+  h.nodesOffset = offset = sizeof(h);
+  h.kidsOffset = offset += h.nodeCount * sizeof(AstNode);
+  h.arraysOffset = offset += h.kidCount * sizeof(int32_t);
+  h.nameOffsetsOffset = offset += h.arrayCount * sizeof(AstArray);
+  h.namesOffset = offset += h.nameCount * sizeof(uint32_t);
+  h.fileSize = offset + h.nameBytes;
+  /* the offsets are 32 bits */
+  size = sizeof(h) + (unsigned long long)ft->count * sizeof(AstNode) +
+         (unsigned long long)ft->kidCount * sizeof(int32_t) +
+         (unsigned long long)ft->arrayCount * sizeof(AstArray) +
+         (unsigned long long)h.nameCount * sizeof(uint32_t) + h.nameBytes;
+  if (size > UINT32_MAX)
+  {
+    fprintf(stderr, "The syntax tree is too large for %s\n", path);
+    return FALSE;
+  }
+  f = fopen(path, "wb");
+  if (f == NULL)
+  {
+    fprintf(stderr, "Unable to write %s\n", path);
+    return FALSE;
+  }
+  fwrite(&h, sizeof(h), 1, f);
+  fwrite(ft->nodes, sizeof(AstNode), ft->count, f);
+  fwrite(ft->kids, sizeof(int32_t), ft->kidCount, f);
+  fwrite(ft->arrays, sizeof(AstArray), ft->arrayCount, f);
+  for (offset = 0, i = 0; i < (int)h.nameCount; i++)
+  {
+    fwrite(&offset, sizeof(offset), 1, f);
+    offset += strlen(symbolName(symbols, i)) + 1;
+  }
+  for (i = 0; i < (int)h.nameCount; i++)
+  {
+    const char *name = symbolName(symbols, i);
+    fwrite(name, 1, strlen(name) + 1, f);
+  }
+  ok = !ferror(f);
+  ok &= fclose(f) == 0;
+  if (!ok)
+    fprintf(stderr, "Unable to write %s\n", path);
+  return ok;
+}
+
+/* inFile tells if count items of size bytes from
+   offset lie within af, 4-byte aligned */
+static int inFile(const AstFile *af, uint32_t offset, uint32_t count, size_t size)
+{
+  return offset % 4 == 0 && offset <= af->size &&
+         (unsigned long long)count * size <= af->size - offset;
+}
+
+/* later tells if n is NONODE or a node of af past
+   node i */
+static int later(const AstFile *af, uint32_t i, int32_t n)
+{
+  return n == NONODE || (n > (int32_t)i && (uint32_t)n < af->header->nodeCount);
+}
+
+/* isName tells if id is NOSYMBOL or a name of af */
+static int isName(const AstFile *af, int32_t id)
+{
+  return id == NOSYMBOL || (id >= 0 && (uint32_t)id < af->header->nameCount);
+}
+
+/* nodesFit tells if every index in the sections of
+   af is within the section it points into. Nodes are
+   in preorder, so the next node of a list and the
+   first nodes of a node's children all come after it:
+   holding them to that, no walk can loop */
+static int nodesFit(const AstFile *af)
+{
+  /* kinds of each NodeKind */
+  static const int kinds[] = {FunK + 1, ReturnK + 1, IdK + 1};
+  const AstHeader *h = af->header;
+  uint32_t i;
+  int k;
+  if (h->root != NONODE && (h->root < 0 || (uint32_t)h->root >= h->nodeCount))
+    return FALSE;
+  for (i = 0; i < h->nameCount; i++)
+    if (af->nameOffsets[i] >= h->nameBytes)
+      return FALSE;
+  for (i = 0; i < h->arrayCount; i++)
+    if (!isName(af, af->arrays[i].name))
+      return FALSE;
+  for (i = 0; i < h->nodeCount; i++)
+  {
+    const AstNode *f = &af->nodes[i];
+    if (f->nodekind > ExpK || f->kind >= kinds[f->nodekind] || f->nkids > MAXCHILDREN ||
+        !later(af, i, f->next))
+      return FALSE;
+    if (f->nkids > 0 && (f->kids < 0 || (uint32_t)f->kids + f->nkids > h->kidCount))
+      return FALSE;
+    for (k = 0; k < f->nkids; k++)
+      if (!later(af, i, af->kids[f->kids + k]))
+        return FALSE;
+    if (f->nodekind == DclrK && f->kind == VarArrK)
+    {
+      if (f->attr < 0 || (uint32_t)f->attr >= h->arrayCount)
+        return FALSE;
+    }
+    else if (f->nodekind == DclrK || (f->nodekind == ExpK && f->kind >= IdArrK))
+    {
+      if (!isName(af, f->attr))
+        return FALSE;
+    }
+    else if (f->nodekind == ExpK && f->kind == OpK && (f->attr < 0 || f->attr >= NTOKENTYPES))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+int openAstFile(const char *path, AstFile *af)
+{
+  struct stat st;
+  const AstHeader *h;
+  int fd = open(path, O_RDONLY);
+  memset(af, 0, sizeof(*af));
+  if (fd < 0)
+  {
+    fprintf(stderr, "File %s not found\n", path);
+    return FALSE;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(AstHeader) ||
+      (af->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+  {
+    close(fd);
+    af->map = NULL;
+    fprintf(stderr, "%s is not an AST file\n", path);
+    return FALSE;
+  }
+  close(fd);
+  af->size = (size_t)st.st_size;
+  af->header = h = (const AstHeader *)af->map;
+  if (memcmp(h->magic, ASTMAGIC, 4) == 0 && h->byteOrder == ASTBYTEORDER &&
+      h->version != ASTVERSION)
+  {
+    fprintf(stderr, "%s is an AST file of version %u, not %d\n", path, h->version, ASTVERSION);
+    closeAstFile(af);
+    return FALSE;
+  }
+  if (memcmp(h->magic, ASTMAGIC, 4) != 0 || h->byteOrder != ASTBYTEORDER ||
+      h->headerSize != sizeof(AstHeader) || h->fileSize != af->size ||
+      !inFile(af, h->nodesOffset, h->nodeCount, sizeof(AstNode)) ||
+      !inFile(af, h->kidsOffset, h->kidCount, sizeof(int32_t)) ||
+      !inFile(af, h->arraysOffset, h->arrayCount, sizeof(AstArray)) ||
+      !inFile(af, h->nameOffsetsOffset, h->nameCount, sizeof(uint32_t)) ||
+      h->namesOffset > af->size || h->nameBytes != af->size - h->namesOffset ||
+      (h->nameBytes > 0 && ((const char *)af->map)[af->size - 1] != '\0'))
+  {
+    fprintf(stderr, "%s is not an AST file\n", path);
+    closeAstFile(af);
+    return FALSE;
+  }
+  af->nodes = (const AstNode *)((const char *)af->map + h->nodesOffset);
+  af->kids = (const int32_t *)((const char *)af->map + h->kidsOffset);
+  af->arrays = (const AstArray *)((const char *)af->map + h->arraysOffset);
+  af->nameOffsets = (const uint32_t *)((const char *)af->map + h->nameOffsetsOffset);
+  af->names = (const char *)af->map + h->namesOffset;
+  if (!nodesFit(af))
+  {
+    fprintf(stderr, "%s is not an AST file\n", path);
+    closeAstFile(af);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void closeAstFile(AstFile *af)
+{
+  if (af->map != NULL)
+    munmap(af->map, af->size);
+  memset(af, 0, sizeof(*af));
+}
+
+void viewAstFile(const AstFile *af, FlatTree *ft)
+{
+  uint32_t i;
+  initFlatTree(ft);
+  ft->nodes = (FlatNode *)af->nodes;
+  ft->count = ft->capacity = af->header->nodeCount;
+  ft->kids = (int *)af->kids;
+  ft->kidCount = ft->kidCapacity = af->header->kidCount;
+  ft->arrays = (Array *)af->arrays;
+  ft->arrayCount = ft->arrayCapacity = af->header->arrayCount;
+  ft->root = af->header->root;
+  /* a list has at most nodeCount nodes */
+  for (ft->last = ft->root, i = 0; ft->last != NONODE && ft->nodes[ft->last].next != NONODE &&
+                                   i < af->header->nodeCount; i++)
+    ft->last = ft->nodes[ft->last].next;
+}
@@ -0,0 +1,112 @@
+/****************************************************/
+/* File: astfile.h                                  */
+/* Binary syntax tree files: a FlatTree and its     */
+/* names laid out to be mapped and read in place    */
+/****************************************************/
+
+#ifndef _ASTFILE_H_
+#define _ASTFILE_H_
+#include <stddef.h>
+#include <stdint.h>
+#include "globals.h"
+#include "flattree.h"
+#include "intern.h"
+
+/* An AST file is an AstHeader and the sections it
+ * gives the offsets of, every field a 32-bit word
+ * (but the first four bytes of a node) in the byte
+ * order of the writer, which readers check:
+ *
+ *   nodes        nodeCount AstNodes, in preorder
+ *   kids         kidCount int32s, first nodes of the
+ *                children lists (see FlatNode)
+ *   arrays       arrayCount AstArrays, of VarArrK
+ *   nameOffsets  nameCount uint32s, where symbol id
+ *                i starts in names
+ *   names        nameBytes of NUL-terminated names
+ *
+ * Node kinds, types and operators are the values of
+ * the NodeKind, StmtKind, ExpKind, DclrKind,
+ * TypeSpecifier and TokenType enums of globals.h;
+ * ASTVERSION changes whenever any of them or the
+ * layout does. A reader maps the file and follows
+ * the indices directly, see openAstFile
+ */
+#define ASTMAGIC "CAST"
+#define ASTBYTEORDER 0x01020304u
+#define ASTVERSION 1
+
+typedef struct astHeader
+{
+  char magic[4];        /* ASTMAGIC */
+  uint32_t byteOrder;   /* ASTBYTEORDER as the writer stored it */
+  uint32_t version;     /* ASTVERSION */
+  uint32_t headerSize;  /* sizeof(AstHeader) */
+  uint32_t fileSize;
+  int32_t root;         /* first top-level declaration, or NONODE */
+  uint32_t nodeCount, nodesOffset;
+  uint32_t kidCount, kidsOffset;
+  uint32_t arrayCount, arraysOffset;
+  uint32_t nameCount, nameOffsetsOffset;
+  uint32_t nameBytes, namesOffset;
+} AstHeader;
+
+/* an AstNode is stored exactly as a FlatNode */
+typedef struct astNode
+{
+  uint8_t nodekind, kind, type, nkids;
+  int32_t lineno;
+  int32_t attr; /* op, val, symbol id or index in arrays */
+  int32_t next; /* next node of its list, or NONODE */
+  int32_t kids; /* its first entry in kids */
+} AstNode;
+
+typedef struct astArray
+{
+  int32_t name;
+  uint32_t len;
+} AstArray;
+
+/* an AstFile is an AST file mapped for reading */
+typedef struct astFile
+{
+  const AstHeader *header;
+  const AstNode *nodes;
+  const int32_t *kids;
+  const AstArray *arrays;
+  const uint32_t *nameOffsets;
+  const char *names;
+  void *map;
+  size_t size;
+} AstFile;
+
+/* ASTKID is the first node of child list k of node
+ * n of af; ASTNAME the name of symbol id
+ */
+#define ASTKID(af, n, k) ((af)->kids[(af)->nodes[n].kids + (k)])
+#define ASTNAME(af, id) ((af)->names + (af)->nameOffsets[id])
+
+/* Function writeAstFile writes ft, whose names are in
+ * symbols, to the AST file path; FALSE on failure
+ */
+int writeAstFile(const char *path, const FlatTree *ft, const InternTable *symbols);
+
+/* Function openAstFile maps the AST file path into af.
+ * It checks the header, that every section lies
+ * within the file and that every index in the nodes
+ * is within its section; it returns FALSE, with a
+ * message on stderr, if path is not an AST file of
+ * this version
+ */
+int openAstFile(const char *path, AstFile *af);
+
+/* Procedure closeAstFile unmaps af */
+void closeAstFile(AstFile *af);
+
+/* Procedure viewAstFile points ft at the sections of
+ * af, without copying, for the FlatTree functions
+ * that only read; ft must not be destroyed
+ */
+void viewAstFile(const AstFile *af, FlatTree *ft);
+
+#endif
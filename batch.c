@@ -0,0 +1,409 @@
+/****************************************************/
+/* File: batch.c                                    */
+/* Compiling many C- files in one process: a pool   */
+/* of threads, each with a deque of files, stealing */
+/* from the others once its own deque runs dry      */
+/****************************************************/
+
+#include "batch.h"
+#include "util.h"
+#include "scan.h"
+#include "parse.h"
+#include "flattree.h"
+#include "writer.h"
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* MAXWORKERS = most threads compileBatch starts */
+#define MAXWORKERS 256
+
+/**************************************************/
+/***********   collecting the files     ************/
+/**************************************************/
+
+static int addName(BatchList *list, const char *name, int n)
+{
+  char *s;
+  if (list->count == list->capacity)
+  {
+    int capacity = list->capacity ? 2 * list->capacity : 64;
+    char **names = (char **)realloc(list->names, capacity * sizeof(char *));
+    if (names == NULL)
+      return FALSE;
+    list->names = names;
+    list->capacity = capacity;
+  }
+  s = (char *)malloc(n + 1);
+  if (s == NULL)
+    return FALSE;
+  memcpy(s, name, n);
+  s[n] = '\0';
+  list->names[list->count++] = s;
+  return TRUE;
+}
+
+static int isSource(const char *name)
+{
+  int n = strlen(name);
+  return (n > 3 && strcmp(name + n - 3, ".c-") == 0) ||
+         (n > 4 && strcmp(name + n - 4, ".tny") == 0);
+}
+
+static int compareNames(const void *a, const void *b)
+{
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* addDirectory adds the sources under dir, the
+   entries of each directory sorted by name so the
+   batch is the same from one run to the next */
+static int addDirectory(BatchList *list, const char *dir)
+{
+  BatchList entries = {0};
+  struct dirent *e;
+  struct stat st;
+  char path[4096];
+  int i, ok = TRUE;
+  DIR *d = opendir(dir);
+  if (d == NULL)
+  {
+    fprintf(stderr, "Directory %s not readable\n", dir);
+    return FALSE;
+  }
+  while ((e = readdir(d)) != NULL)
+    if (e->d_name[0] != '.')
+      ok &= addName(&entries, e->d_name, strlen(e->d_name));
+  closedir(d);
+  qsort(entries.names, entries.count, sizeof(char *), compareNames);
+  for (i = 0; i < entries.count && ok; i++)
+  {
+    int n = snprintf(path, sizeof(path), "%s/%s", dir, entries.names[i]);
+    if (n >= (int)sizeof(path) || stat(path, &st) != 0)
+      continue;
+    if (S_ISDIR(st.st_mode))
+      ok = addDirectory(list, path);
+    else if (S_ISREG(st.st_mode) && isSource(path))
+      ok = addName(list, path, n);
+  }
+  freeBatchList(&entries);
+  if (!ok)
+    fprintf(stderr, "Out of memory listing %s\n", dir);
+  return ok;
+}
+
+/* addResponseFile adds each non-blank line of file */
+static int addResponseFile(BatchList *list, const char *file)
+{
+  char line[4096];
+  int n, ok = TRUE;
+  FILE *f = fopen(file, "r");
+  if (f == NULL)
+  {
+    fprintf(stderr, "File %s not found\n", file);
+    return FALSE;
+  }
+  while (ok && fgets(line, sizeof(line), f) != NULL)
+  {
+    n = strlen(line);
+    while (n > 0 && isspace((unsigned char)line[n - 1]))
+      n--;
+    if (n > 0)
+      ok = addName(list, line, n);
+  }
+  fclose(f);
+  if (!ok)
+    fprintf(stderr, "Out of memory reading %s\n", file);
+  return ok;
+}
+
+int addBatchInput(BatchList *list, const char *arg)
+{
+  struct stat st;
+  if (arg[0] == '@')
+    return addResponseFile(list, arg + 1);
+  if (stat(arg, &st) == 0 && S_ISDIR(st.st_mode))
+    return addDirectory(list, arg);
+  if (!addName(list, arg, strlen(arg)))
+  {
+    fprintf(stderr, "Out of memory\n");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void freeBatchList(BatchList *list)
+{
+  int i;
+  for (i = 0; i < list->count; i++)
+    free(list->names[i]);
+  free(list->names);
+  list->names = NULL;
+  list->count = list->capacity = 0;
+}
+
+/**************************************************/
+/***********   compiling one file       ************/
+/**************************************************/
+
+/* compileFile compiles name as main() does a single
+   file, with the listing going to listing and the
+   tree written in format; it returns TRUE if the file
+   could not be read or had syntax errors */
+static int compileFile(const char *name, int flat, TreeFormat format, FILE *listing)
+{
+  TreeNode *syntaxTree = NULL;
+  TreeWriter w;
+  FlatTree ft;
+  CompileContext *cx;
+  int failed;
+  FILE *source = fopen(name, "r");
+  fprintf(listing, "C-minus COMPILATION: %s\n", name);
+  if (source == NULL)
+  {
+    fprintf(listing, "File %s not found\n", name);
+    return TRUE;
+  }
+  cx = newCompileContext(source, listing);
+  if (cx == NULL)
+  {
+    fprintf(listing, "Out of memory\n");
+    fclose(source);
+    return TRUE;
+  }
+  scan(cx);
+  initFlatTree(&ft);
+  if (flat)
+    parseFlat(cx, &ft);
+  else
+    syntaxTree = parse(cx);
+  if (TraceParse)
+  {
+    fprintf(listing, "\nSyntax tree:\n");
+    startTreeWriter(&w, listing, format, cx->symbols);
+    w.indent = cx->indentno;
+    if (flat)
+      writeFlatTree(&w, &ft);
+    else
+      writeTree(&w, syntaxTree);
+    endTreeWriter(&w);
+  }
+  failed = cx->Error;
+  destroyFlatTree(&ft);
+  freeCompileContext(cx);
+  fclose(source);
+  return failed;
+}
+
+/**************************************************/
+/***********   the thread pool          ************/
+/**************************************************/
+
+/* a Job is one file of the batch; its listing is
+   kept in text until every file before it has been
+   written to the report */
+typedef struct job
+{
+  char *text;
+  size_t size;
+  int done, failed;
+} Job;
+
+/* a Worker owns the files queue[head] up to
+   queue[tail]: it takes them from the head, idle
+   workers steal them from the tail */
+typedef struct worker
+{
+  pthread_mutex_t lock;
+  int head, tail;
+  pthread_t thread;
+  struct batch *batch;
+  int id;
+} Worker;
+
+typedef struct batch
+{
+  const BatchList *list;
+  int flat;
+  TreeFormat format;
+  const char *outDir;
+  FILE *report;
+  int *queue; /* the deques of the workers, end to end */
+  Job *jobs;
+  Worker *workers;
+  int workerCount;
+  pthread_mutex_t reportLock;
+  int written; /* jobs[0..written-1] are in report */
+  int failed;
+} Batch;
+
+/* nextJob returns the next file for w, its own or
+   stolen, or -1 once every deque is empty. Each file
+   is a whole compilation, so one lock per file costs
+   nothing next to it */
+static int nextJob(Worker *w)
+{
+  Batch *b = w->batch;
+  int i, job = -1;
+  pthread_mutex_lock(&w->lock);
+  if (w->head < w->tail)
+    job = b->queue[w->head++];
+  pthread_mutex_unlock(&w->lock);
+  for (i = 1; job < 0 && i < b->workerCount; i++)
+  {
+    Worker *victim = &b->workers[(w->id + i) % b->workerCount];
+    pthread_mutex_lock(&victim->lock);
+    if (victim->head < victim->tail)
+      job = b->queue[--victim->tail];
+    pthread_mutex_unlock(&victim->lock);
+  }
+  return job;
+}
+
+/* listingName makes the name of the listing of
+   file, job of the batch, in outDir: the number of
+   the job, '_' and file with each '/' made '_', less
+   any leading "/" and "./". The number keeps apart
+   names such as a/b.c- and a_b.c-, and a file named
+   twice */
+static void listingName(char *buf, int size, const char *outDir, int job, const char *file)
+{
+  int n = snprintf(buf, size, "%s/%d_", outDir, job);
+  if (n >= size - 5)
+    n = size - 5;
+  while (file[0] == '/' || (file[0] == '.' && file[1] == '/'))
+    file += (file[0] == '/') ? 1 : 2;
+  for (; *file && n < size - 5; file++)
+    buf[n++] = (*file == '/') ? '_' : *file;
+  strcpy(buf + n, ".txt");
+}
+
+/* finishJob records the end of job and writes every
+   listing now due to the report, in batch order */
+static void finishJob(Batch *b, int job, int failed)
+{
+  pthread_mutex_lock(&b->reportLock);
+  b->jobs[job].done = TRUE;
+  b->jobs[job].failed = failed;
+  b->failed += failed;
+  while (b->written < b->list->count && b->jobs[b->written].done)
+  {
+    Job *j = &b->jobs[b->written++];
+    if (j->text != NULL)
+      fwrite(j->text, 1, j->size, b->report);
+    free(j->text);
+    j->text = NULL;
+  }
+  pthread_mutex_unlock(&b->reportLock);
+}
+
+static void *runWorker(void *arg)
+{
+  Worker *w = (Worker *)arg;
+  Batch *b = w->batch;
+  char path[4096];
+  int job, failed;
+  FILE *listing;
+  while ((job = nextJob(w)) >= 0)
+  {
+    const char *name = b->list->names[job];
+    if (b->outDir != NULL)
+    {
+      listingName(path, sizeof(path), b->outDir, job, name);
+      listing = fopen(path, "w");
+    }
+    else
+      listing = open_memstream(&b->jobs[job].text, &b->jobs[job].size);
+    if (listing == NULL)
+    {
+      fprintf(stderr, "Unable to write the listing of %s\n", name);
+      failed = TRUE;
+    }
+    else
+    {
+      failed = compileFile(name, b->flat, b->format, listing);
+      fclose(listing);
+    }
+    finishJob(b, job, failed);
+  }
+  return arg;
+}
+
+int compileBatch(const BatchList *list, int threads, int flat, TreeFormat format,
+                 const char *outDir, FILE *report)
+{
+  Batch b;
+  struct stat st;
+  int i, k, n;
+  if (outDir != NULL && mkdir(outDir, 0777) != 0 &&
+      (errno != EEXIST || stat(outDir, &st) != 0 || !S_ISDIR(st.st_mode)))
+  {
+    fprintf(stderr, "Unable to make directory %s: %s\n", outDir,
+            errno == EEXIST ? "not a directory" : strerror(errno));
+    return list->count;
+  }
+#ifdef _SC_NPROCESSORS_ONLN
+  if (threads <= 0)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (threads > MAXWORKERS)
+    threads = MAXWORKERS;
+  if (threads > list->count)
+    threads = list->count;
+  if (threads < 1)
+    threads = 1;
+  memset(&b, 0, sizeof(b));
+  b.list = list;
+  b.flat = flat;
+  b.format = format;
+  b.outDir = outDir;
+  b.report = report;
+  b.workerCount = threads;
+  b.queue = (int *)malloc((list->count + 1) * sizeof(int));
+  b.jobs = (Job *)calloc(list->count + 1, sizeof(Job));
+  b.workers = (Worker *)calloc(threads, sizeof(Worker));
+  if (b.queue == NULL || b.jobs == NULL || b.workers == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    free(b.queue);
+    free(b.jobs);
+    free(b.workers);
+    return list->count;
+  }
+  pthread_mutex_init(&b.reportLock, NULL);
+
+  /* deal the files out round robin, so the workers
+     all move through the batch together and few
+     listings wait on an earlier one to be written */
+  for (n = 0, i = 0; i < threads; i++)
+  {
+    Worker *w = &b.workers[i];
+    pthread_mutex_init(&w->lock, NULL);
+    w->batch = &b;
+    w->id = i;
+    w->head = n;
+    for (k = i; k < list->count; k += threads)
+      b.queue[n++] = k;
+    w->tail = n;
+  }
+
+  for (i = 1; i < threads; i++)
+    if (pthread_create(&b.workers[i].thread, NULL, runWorker, &b.workers[i]) != 0)
+    {
+      fprintf(stderr, "unable to start a batch thread\n");
+      exit(1);
+    }
+  runWorker(&b.workers[0]);
+  for (i = 1; i < threads; i++)
+    pthread_join(b.workers[i].thread, NULL);
+
+  for (i = 0; i < threads; i++)
+    pthread_mutex_destroy(&b.workers[i].lock);
+  pthread_mutex_destroy(&b.reportLock);
+  free(b.queue);
+  free(b.jobs);
+  free(b.workers);
+  return b.failed;
+}
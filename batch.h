@@ -0,0 +1,46 @@
+/****************************************************/
+/* File: batch.h                                    */
+/* Compiling many C- files in one process           */
+/****************************************************/
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+#include "globals.h"
+#include "writer.h"
+
+/* a BatchList is the growing list of files of a
+ * batch; a zeroed BatchList is an empty one
+ */
+typedef struct batchList
+{
+  char **names;
+  int count;
+  int capacity;
+} BatchList;
+
+/* Function addBatchInput adds the files arg names to
+ * list: arg itself, every C- source (*.c-, *.tny)
+ * under it in name order if it is a directory, or
+ * each line of the response file if it is @file.
+ * It returns FALSE, having said why on stderr, if
+ * arg cannot be read
+ */
+int addBatchInput(BatchList *list, const char *arg);
+
+/* Procedure freeBatchList frees the names of list,
+ * leaving it empty
+ */
+void freeBatchList(BatchList *list);
+
+/* Function compileBatch compiles every file of list
+ * on up to threads threads (one per CPU if 0). The
+ * listing of each goes to its own file in outDir,
+ * which is made if it does not exist, or, if outDir
+ * is NULL, into report in the order of list. flat is
+ * --flat and format --format. It returns the number
+ * of files that could not be read or had errors
+ */
+int compileBatch(const BatchList *list, int threads, int flat, TreeFormat format,
+                 const char *outDir, FILE *report);
+
+#endif
@@ -0,0 +1,517 @@
+/****************************************************/
+/* File: cache.c                                    */
+/* On-disk cache of parse results, keyed by a hash  */
+/* of the source text                               */
+/****************************************************/
+
+#include "cache.h"
+#include "scan.h"
+#include "intern.h"
+#include "parse.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+/* an entry is one file of the cache directory, named
+   by the 16 hex digits of its key: a CacheHeader,
+   the nodes, kids and arrays of the FlatTree, the
+   symbol names end to end with their NULs, and the
+   diagnostics text. The tokens are not kept: nothing
+   after the parse reads them, and they took several
+   times the bytes of the source. It is only
+   read back by the same build, so it is in the
+   machine's own byte order. check hashes the rest of
+   the header and all that follows it, so a damaged
+   entry is a miss */
+typedef struct cacheHeader
+{
+  char magic[8];
+  unsigned long long key;
+  unsigned long long sourceSize;
+  unsigned long long check;
+  int version;
+  int nodeCount, kidCount, arrayCount, root, last;
+  int symbolCount, nameBytes;
+  int errorCount, errorLine;
+  int textSize;
+} CacheHeader;
+
+static const char cacheMagic[8] = "C-CACHE";
+
+/**************************************************/
+/***********   the key                  ************/
+/**************************************************/
+
+/* hash64 is the 64-bit xxHash of p[0..n) */
+#define PRIME1 11400714785074694791ULL
+#define PRIME2 14029467366897019727ULL
+#define PRIME3 1609587929392839161ULL
+#define PRIME4 9650029242287828579ULL
+#define PRIME5 2870177450012600261ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static unsigned long long read64(const unsigned char *p)
+{
+  unsigned long long v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static unsigned long long hashRound(unsigned long long acc, unsigned long long input)
+{
+  acc += input * PRIME2;
+  acc = ROTL64(acc, 31);
+  return acc * PRIME1;
+}
+
+static unsigned long long hashMerge(unsigned long long h, unsigned long long v)
+{
+  h ^= hashRound(0, v);
+  return h * PRIME1 + PRIME4;
+}
+
+static unsigned long long hash64(const void *data, size_t n, unsigned long long seed)
+{
+  const unsigned char *p = (const unsigned char *)data;
+  const unsigned char *end = p + n;
+  unsigned long long h;
+  unsigned int k;
+  if (n >= 32)
+  {
+    unsigned long long v1 = seed + PRIME1 + PRIME2, v2 = seed + PRIME2;
+    unsigned long long v3 = seed, v4 = seed - PRIME1;
+    for (; end - p >= 32; p += 32)
+    {
+      v1 = hashRound(v1, read64(p));
+      v2 = hashRound(v2, read64(p + 8));
+      v3 = hashRound(v3, read64(p + 16));
+      v4 = hashRound(v4, read64(p + 24));
+    }
+    h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+    h = hashMerge(hashMerge(hashMerge(hashMerge(h, v1), v2), v3), v4);
+  }
+  else
+    h = seed + PRIME5;
+  h += n;
+  for (; end - p >= 8; p += 8)
+  {
+    h ^= hashRound(0, read64(p));
+    h = ROTL64(h, 27) * PRIME1 + PRIME4;
+  }
+  if (end - p >= 4)
+  {
+    memcpy(&k, p, 4);
+    h ^= k * PRIME1;
+    h = ROTL64(h, 23) * PRIME2 + PRIME3;
+    p += 4;
+  }
+  for (; p < end; p++)
+  {
+    h ^= *p * PRIME5;
+    h = ROTL64(h, 11) * PRIME1;
+  }
+  h ^= h >> 33;
+  h *= PRIME2;
+  h ^= h >> 29;
+  h *= PRIME3;
+  return h ^ (h >> 32);
+}
+
+/* cacheKey hashes the source of cx along with all
+   else that decides what its parse looks like */
+static unsigned long long cacheKey(CompileContext *cx, size_t *size)
+{
+  char stamp[64];
+  const char *text = sourceText(cx, size);
+  int n = snprintf(stamp, sizeof(stamp), "C- %d %d %d", CACHEVERSION, MaxErrors, EchoSource || TraceScan);
+  return hash64(text, *size, hash64(stamp, n, 0));
+}
+
+/* NPARTS is the number of parts of an entry after
+   its header; partSizes sets their sizes from h */
+#define NPARTS 5
+
+static void partSizes(const CacheHeader *h, size_t *sizes)
+{
+  sizes[0] = sizeof(FlatNode) * (size_t)h->nodeCount;
+  sizes[1] = sizeof(int) * (size_t)h->kidCount;
+  sizes[2] = sizeof(Array) * (size_t)h->arrayCount;
+  sizes[3] = (size_t)h->nameBytes;
+  sizes[4] = (size_t)h->textSize;
+}
+
+/* entryCheck chains hash64 through the header h,
+   its check left out, and the parts of an entry,
+   wherever each of them is held */
+static unsigned long long entryCheck(const CacheHeader *h, const void *const *parts, const size_t *sizes)
+{
+  CacheHeader zeroed;
+  unsigned long long check;
+  int i;
+  memcpy(&zeroed, h, sizeof(zeroed));
+  zeroed.check = 0;
+  check = hash64(&zeroed, sizeof(zeroed), 0);
+  for (i = 0; i < NPARTS; i++)
+    check = hash64(parts[i], sizes[i], check);
+  return check;
+}
+
+static void entryName(char *buf, int size, const char *dir, unsigned long long key)
+{
+  snprintf(buf, size, "%s/%016llx", dir, key);
+}
+
+/**************************************************/
+/***********   looking up               ************/
+/**************************************************/
+
+/* takeArray copies count items of size bytes from
+   *p into a new array of capacity cap, moving *p on */
+static void *takeArray(const char **p, int count, size_t size, int cap)
+{
+  void *a = malloc((cap > 0 ? cap : 1) * size);
+  if (a == NULL)
+  {
+    fprintf(stderr, "Out of memory reading the parse cache\n");
+    exit(1);
+  }
+  memcpy(a, *p, count * size);
+  *p += count * size;
+  return a;
+}
+
+/* namesFit tells whether the names of an entry are
+   symbolCount strings that fill its names part */
+static int namesFit(const CacheHeader *h, const char *names)
+{
+  const char *end = names + h->nameBytes, *nul;
+  int i;
+  for (i = 0; i < h->symbolCount; i++)
+  {
+    if ((nul = (const char *)memchr(names, '\0', end - names)) == NULL)
+      return FALSE;
+    names = nul + 1;
+  }
+  return h->symbolCount >= 0 && names == end;
+}
+
+int loadCachedParse(const char *dir, CompileContext *cx, FlatTree *ft)
+{
+  char path[4096];
+  CacheHeader h;
+  size_t sourceSize, entrySize, total, sizes[NPARTS];
+  const void *parts[NPARTS];
+  unsigned long long key = cacheKey(cx, &sourceSize);
+  struct stat st;
+  const char *p, *name;
+  char *entry;
+  int i, fd;
+  entryName(path, sizeof(path), dir, key);
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return FALSE;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(h) ||
+      (entry = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+  {
+    close(fd);
+    return FALSE;
+  }
+  close(fd);
+  entrySize = (size_t)st.st_size;
+  memcpy(&h, entry, sizeof(h));
+  partSizes(&h, sizes);
+  for (i = 0, total = sizeof(h); i < NPARTS; i++)
+  {
+    parts[i] = entry + total;
+    total += sizes[i];
+  }
+  /* a short, foreign or damaged entry is a miss */
+  if (memcmp(h.magic, cacheMagic, 8) != 0 ||
+      h.version != CACHEVERSION || h.key != key || h.sourceSize != sourceSize ||
+      h.nodeCount < 0 || h.kidCount < 0 || h.arrayCount < 0 ||
+      h.nameBytes < 0 || h.textSize < 0 || entrySize != total ||
+      entryCheck(&h, parts, sizes) != h.check || !namesFit(&h, (const char *)parts[3]))
+  {
+    munmap(entry, entrySize);
+    return FALSE;
+  }
+  p = entry + sizeof(h);
+  destroyFlatTree(ft);
+  ft->nodes = (FlatNode *)takeArray(&p, h.nodeCount, sizeof(FlatNode), h.nodeCount);
+  ft->count = ft->capacity = h.nodeCount;
+  ft->kids = (int *)takeArray(&p, h.kidCount, sizeof(int), h.kidCount);
+  ft->kidCount = ft->kidCapacity = h.kidCount;
+  ft->arrays = (Array *)takeArray(&p, h.arrayCount, sizeof(Array), h.arrayCount);
+  ft->arrayCount = ft->arrayCapacity = h.arrayCount;
+  ft->root = h.root;
+  ft->last = h.last;
+  /* interned in order, the names get their old ids */
+  for (i = 0, name = p; i < h.symbolCount; i++)
+  {
+    int n = strlen(name);
+    internName(cx->symbols, name, n);
+    name += n + 1;
+  }
+  p += h.nameBytes;
+  if (cx->listing != NULL)
+    fwrite(p, 1, h.textSize, cx->listing);
+  cx->errorCount = h.errorCount;
+  cx->errorLine = h.errorLine;
+  cx->Error = h.errorCount > 0;
+  munmap(entry, entrySize);
+  /* a hit makes the entry the most recently used */
+  utime(path, NULL);
+  return TRUE;
+}
+
+/**************************************************/
+/***********   storing and evicting     ************/
+/**************************************************/
+
+/* CacheFile is one entry seen by evictCache */
+typedef struct cacheFile
+{
+  char name[20];
+  struct timespec used;
+  off_t size;
+} CacheFile;
+
+static int leastRecent(const void *a, const void *b)
+{
+  const CacheFile *x = (const CacheFile *)a, *y = (const CacheFile *)b;
+  if (x->used.tv_sec != y->used.tv_sec)
+    return (x->used.tv_sec > y->used.tv_sec) - (x->used.tv_sec < y->used.tv_sec);
+  return (x->used.tv_nsec > y->used.tv_nsec) - (x->used.tv_nsec < y->used.tv_nsec);
+}
+
+/* isEntry tells whether name in dir is a cache entry:
+   16 hex digits naming a regular file that starts
+   with the cache magic. Nothing else in dir is ever
+   counted or deleted */
+static int isEntry(const char *dir, const char *name, struct stat *st)
+{
+  char path[4096], magic[8];
+  int i, fd, ok;
+  for (i = 0; i < 16; i++)
+    if (!isxdigit((unsigned char)name[i]) || isupper((unsigned char)name[i]))
+      return FALSE;
+  if (name[16] != '\0')
+    return FALSE;
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return FALSE;
+  ok = fstat(fd, st) == 0 && S_ISREG(st->st_mode) &&
+       read(fd, magic, 8) == 8 && memcmp(magic, cacheMagic, 8) == 0;
+  close(fd);
+  return ok;
+}
+
+/* evictCache deletes the least recently used entries
+   of dir until they hold at most limit bytes, and
+   returns the bytes they hold then; files being
+   written (".tmp...") are left alone */
+static long long evictCache(const char *dir, long long limit)
+{
+  CacheFile *files = NULL;
+  int count = 0, capacity = 0, i;
+  long long total = 0;
+  char path[4096];
+  struct dirent *e;
+  struct stat st;
+  DIR *d = opendir(dir);
+  if (d == NULL)
+    return 0;
+  while ((e = readdir(d)) != NULL)
+  {
+    if (!isEntry(dir, e->d_name, &st))
+      continue;
+    if (count == capacity)
+    {
+      CacheFile *grown;
+      capacity = capacity ? 2 * capacity : 256;
+      grown = (CacheFile *)realloc(files, capacity * sizeof(CacheFile));
+      if (grown == NULL)
+        break;
+      files = grown;
+    }
+    strcpy(files[count].name, e->d_name);
+    files[count].used = st.st_mtim;
+    files[count].size = st.st_size;
+    total += st.st_size;
+    count++;
+  }
+  closedir(d);
+  if (total > limit)
+  {
+    qsort(files, count, sizeof(CacheFile), leastRecent);
+    for (i = 0; i < count && total > limit; i++)
+    {
+      snprintf(path, sizeof(path), "%s/%s", dir, files[i].name);
+      if (unlink(path) == 0)
+        total -= files[i].size;
+    }
+  }
+  free(files);
+  return total;
+}
+
+/* SIZEFILE is the file of a cache directory that
+   holds, as a long long, the bytes its entries take,
+   so a store need not look at every entry. It is
+   updated under an flock, as several compilers may
+   share the cache */
+#define SIZEFILE ".size"
+
+/* addCacheSize adds added bytes to the size of the
+   cache in dir. Only once the cache grows past limit
+   are its entries looked at, to evict the least
+   recently used down to 7/8 of limit, so that it is
+   not done again for many stores. The size is also
+   counted afresh, which mends it if entries were
+   deleted by hand. A missing or bad size file is
+   mended the same way */
+static void addCacheSize(const char *dir, long long added, long long limit)
+{
+  char path[4096];
+  long long total;
+  int fd;
+  snprintf(path, sizeof(path), "%s/%s", dir, SIZEFILE);
+  fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    evictCache(dir, limit);
+    return;
+  }
+  flock(fd, LOCK_EX);
+  if (pread(fd, &total, sizeof(total), 0) != (ssize_t)sizeof(total) || total < 0)
+    total = evictCache(dir, limit);
+  else
+    total += added;
+  if (total > limit)
+    total = evictCache(dir, limit - limit / 8);
+  if (total < 0)
+    total = 0;
+  pwrite(fd, &total, sizeof(total), 0);
+  close(fd);
+}
+
+/* readListing returns what was written to listing
+   from offset start on, NULL if it can not be
+   read back */
+static char *readListing(FILE *listing, long start, int *size)
+{
+  long end;
+  char *text;
+  if (listing == NULL || (end = ftell(listing)) < start || fseek(listing, start, SEEK_SET) != 0)
+    return NULL;
+  *size = (int)(end - start);
+  text = (char *)malloc(*size + 1);
+  if (text != NULL && fread(text, 1, *size, listing) != (size_t)*size)
+  {
+    free(text);
+    text = NULL;
+  }
+  fseek(listing, end, SEEK_SET);
+  return text;
+}
+
+void storeCachedParse(const char *dir, long long limit, CompileContext *cx,
+                      FlatTree *ft, long listingStart)
+{
+  char path[4096], temp[4096];
+  CacheHeader h;
+  TokenStore *tt = &cx->TokenTable;
+  size_t sourceSize, sizes[NPARTS];
+  const void *parts[NPARTS];
+  long long added;
+  struct stat st;
+  char *text, *names;
+  int i, fd, ok;
+  FILE *f;
+  /* only a whole token stream can be stored */
+  if (tt->first != 0 || tt->count == 0 || TOKENTYPE(cx, tt->count - 1) != ENDFILE)
+    return;
+  memset(&h, 0, sizeof(h));
+  text = readListing(cx->listing, listingStart, &h.textSize);
+  if (text == NULL)
+    return;
+  memcpy(h.magic, cacheMagic, 8);
+  h.key = cacheKey(cx, &sourceSize);
+  h.sourceSize = sourceSize;
+  h.version = CACHEVERSION;
+  h.nodeCount = ft->count;
+  h.kidCount = ft->kidCount;
+  h.arrayCount = ft->arrayCount;
+  h.root = ft->root;
+  h.last = ft->last;
+  h.symbolCount = symbolCount(cx->symbols);
+  for (i = 0; i < h.symbolCount; i++)
+    h.nameBytes += strlen(symbolName(cx->symbols, i)) + 1;
+  h.errorCount = cx->errorCount;
+  h.errorLine = cx->errorLine;
+  names = (char *)malloc(h.nameBytes + 1);
+  if (names == NULL)
+  {
+    free(text);
+    return;
+  }
+  for (i = 0, h.nameBytes = 0; i < h.symbolCount; i++)
+  {
+    const char *name = symbolName(cx->symbols, i);
+    int n = strlen(name) + 1;
+    memcpy(names + h.nameBytes, name, n);
+    h.nameBytes += n;
+  }
+  parts[0] = ft->nodes;
+  parts[1] = ft->kids;
+  parts[2] = ft->arrays;
+  parts[3] = names;
+  parts[4] = text;
+  partSizes(&h, sizes);
+  h.check = entryCheck(&h, parts, sizes);
+
+  /* write a temporary file, then rename it into place
+     so a reader sees the whole entry or none */
+  mkdir(dir, 0777);
+  snprintf(temp, sizeof(temp), "%s/.tmp-XXXXXX", dir);
+  fd = mkstemp(temp);
+  if (fd < 0 || (f = fdopen(fd, "wb")) == NULL)
+  {
+    if (fd >= 0)
+    {
+      close(fd);
+      unlink(temp);
+    }
+    free(names);
+    free(text);
+    return;
+  }
+  fchmod(fd, 0644);
+  fwrite(&h, sizeof(h), 1, f);
+  for (i = 0, added = sizeof(h); i < NPARTS; i++)
+  {
+    fwrite(parts[i], 1, sizes[i], f);
+    added += sizes[i];
+  }
+  free(names);
+  free(text);
+  ok = !ferror(f);
+  ok &= fclose(f) == 0;
+  entryName(path, sizeof(path), dir, h.key);
+  /* an entry of the same key, stored meanwhile by
+     another compiler, is replaced */
+  if (stat(path, &st) == 0)
+    added -= st.st_size;
+  if (!ok || rename(temp, path) != 0)
+  {
+    unlink(temp);
+    return;
+  }
+  addCacheSize(dir, added, limit);
+}
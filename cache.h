@@ -0,0 +1,36 @@
+/****************************************************/
+/* File: cache.h                                    */
+/* On-disk cache of parse results, keyed by a hash  */
+/* of the source text                               */
+/****************************************************/
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+#include "globals.h"
+#include "flattree.h"
+
+/* CACHEVERSION is part of every cache key; change it
+ * whenever the scanner, the grammar, the tree or the
+ * entry layout changes what a cached parse would hold
+ */
+#define CACHEVERSION 4
+
+/* Function loadCachedParse looks the source of cx up
+ * in the cache directory dir. On a hit it fills the
+ * symbols of cx and ft as scan() and parseFlat() would
+ * have, writes the diagnostics they would have written
+ * to the listing, and returns TRUE. The TokenTable is
+ * left empty
+ */
+int loadCachedParse(const char *dir, CompileContext *cx, FlatTree *ft);
+
+/* Procedure storeCachedParse adds the parse of cx, ft
+ * and what was written to its listing from offset
+ * listingStart on, to the cache in dir. Once the
+ * cache holds more than limit bytes, the least
+ * recently used entries are evicted
+ */
+void storeCachedParse(const char *dir, long long limit, CompileContext *cx,
+                      FlatTree *ft, long listingStart);
+
+#endif
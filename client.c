@@ -0,0 +1,248 @@
+/****************************************************/
+/* File: client.c                                   */
+/* A client of the --server mode of the C- compiler */
+/* It starts the server, sends it the files named   */
+/* and prints the answers; with --bench N it times  */
+/* N rounds of requests against N rounds of one     */
+/* compiler process per file, with --edits N the    */
+/* parse of N edits of each file against its parse  */
+/****************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#define TRUE 1
+#define FALSE 0
+
+extern char **environ;
+
+/* the compiler, its pid and the pipes to it */
+static const char *compiler = "./debug.exe";
+static pid_t serverPid;
+static FILE *toServer, *fromServer;
+
+static void startServer(void)
+{
+  int in[2], out[2];
+  if (pipe(in) != 0 || pipe(out) != 0)
+  {
+    perror("pipe");
+    exit(1);
+  }
+  serverPid = fork();
+  if (serverPid < 0)
+  {
+    perror("fork");
+    exit(1);
+  }
+  if (serverPid == 0)
+  {
+    dup2(in[0], 0);
+    dup2(out[1], 1);
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    execl(compiler, compiler, "--server", (char *)NULL);
+    perror(compiler);
+    _exit(127);
+  }
+  close(in[0]);
+  close(out[1]);
+  toServer = fdopen(in[1], "w");
+  fromServer = fdopen(out[0], "r");
+}
+
+static int stopServer(void)
+{
+  int status;
+  fclose(toServer);
+  fclose(fromServer);
+  waitpid(serverPid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+/* send sends a request of the n bytes of body and
+   reads the answer; the listing goes to listing
+   unless it is NULL. It returns the error count of
+   the answer */
+static int send(const char *kind, int tree, const char *body, size_t n, FILE *listing)
+{
+  static char *text = NULL;
+  static size_t capacity = 0;
+  size_t size;
+  int errors;
+  fprintf(toServer, "%s %d %zu\n", kind, tree, n);
+  fwrite(body, 1, n, toServer);
+  fflush(toServer);
+  if (fscanf(fromServer, "%d %zu", &errors, &size) != 2 || fgetc(fromServer) != '\n')
+  {
+    fprintf(stderr, "the server did not answer\n");
+    exit(1);
+  }
+  if (size > capacity)
+  {
+    text = (char *)realloc(text, size);
+    capacity = size;
+    if (text == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+  }
+  if (fread(text, 1, size, fromServer) != size)
+  {
+    fprintf(stderr, "the server's answer was cut short\n");
+    exit(1);
+  }
+  if (listing != NULL)
+    fwrite(text, 1, size, listing);
+  return errors;
+}
+
+/* request sends a file request for name */
+static int request(const char *name, int tree, FILE *listing)
+{
+  return send("file", tree, name, strlen(name), listing);
+}
+
+/* runCompiler compiles name in a process of its own */
+static void runCompiler(const char *name)
+{
+  char *argv[3];
+  pid_t pid;
+  int status;
+  argv[0] = (char *)compiler;
+  argv[1] = (char *)name;
+  argv[2] = NULL;
+  if (posix_spawn(&pid, compiler, NULL, NULL, argv, environ) != 0)
+  {
+    perror(compiler);
+    exit(1);
+  }
+  waitpid(pid, &status, 0);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* bench prints the mean latency of a request, sent
+   to the server and as a process of its own, over
+   rounds rounds of files */
+static void bench(char **files, int count, int rounds)
+{
+  double start, served, spawned;
+  int r, i;
+  startServer();
+  request(files[0], TRUE, NULL); /* warm up */
+  start = now();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < count; i++)
+      request(files[i], TRUE, NULL);
+  served = (now() - start) / ((double)rounds * count);
+  stopServer();
+  start = now();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < count; i++)
+      runCompiler(files[i]);
+  spawned = (now() - start) / ((double)rounds * count);
+  printf("%d requests: server %.1f us each, one process per file %.1f us each (%.1fx)\n",
+         rounds * count, served * 1e6, spawned * 1e6, spawned / served);
+}
+
+/* benchEdits prints, for each file, the mean latency
+   of parsing it whole against that of edits made to
+   it: a line put in at the middle and taken out */
+static void benchEdits(char **files, int count, int edits)
+{
+  char header[64];
+  double start, whole, edited;
+  long size, mid;
+  int i, e, c;
+  startServer();
+  for (i = 0; i < count; i++)
+  {
+    FILE *f = fopen(files[i], "r");
+    if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0)
+    {
+      fprintf(stderr, "File %s not found\n", files[i]);
+      exit(1);
+    }
+    /* just after a line break, near the middle */
+    fseek(f, size / 2, SEEK_SET);
+    while ((c = fgetc(f)) != EOF && c != '\n')
+      ;
+    mid = ftell(f);
+    fclose(f);
+    request(files[i], FALSE, NULL);
+    start = now();
+    for (e = 0; e < edits; e++)
+      request(files[i], FALSE, NULL);
+    whole = (now() - start) / edits;
+    start = now();
+    for (e = 0; e < edits; e++)
+    {
+      int n = (e % 2 == 0) ? sprintf(header, "%ld %ld\n\n", mid, mid)
+                           : sprintf(header, "%ld %ld\n", mid, mid + 1);
+      send("edit", FALSE, header, n, NULL);
+    }
+    edited = (now() - start) / edits;
+    printf("%s: parse %.1f us, edit %.1f us (%.1fx)\n",
+           files[i], whole * 1e6, edited * 1e6, whole / edited);
+  }
+  stopServer();
+}
+
+int main(int argc, char *argv[])
+{
+  int tree = FALSE, rounds = 0, edits = 0, failed = 0;
+  int i;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+  {
+    if (strcmp(argv[i], "--tree") == 0)
+      tree = TRUE;
+    else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+      rounds = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--edits") == 0 && i + 1 < argc)
+      edits = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--compiler") == 0 && i + 1 < argc)
+      compiler = argv[++i];
+    else
+      break;
+  }
+  if (i == argc || argv[i][0] == '-')
+  {
+    fprintf(stderr, "usage: %s [--compiler PATH] [--tree | --bench N | --edits N] <file>...\n", argv[0]);
+    exit(1);
+  }
+  if (rounds > 0)
+  {
+    bench(argv + i, argc - i, rounds);
+    return 0;
+  }
+  if (edits > 0)
+  {
+    benchEdits(argv + i, argc - i, edits);
+    return 0;
+  }
+  startServer();
+  for (; i < argc; i++)
+  {
+    int errors;
+    printf("C-minus COMPILATION: %s\n", argv[i]);
+    errors = request(argv[i], tree, stdout);
+    if (errors != 0)
+      failed++;
+  }
+  fflush(stdout);
+  return (stopServer() != 0 || failed) ? 1 : 0;
+}
@@ -0,0 +1,18 @@
+/****************************************************/
+/* File: cminus.c                                   */
+/* The library interface of the C- front end        */
+/****************************************************/
+
+#include "cminus.h"
+
+CompileContext *parseBuffer(const char *text, size_t size, TreeNode **tree)
+{
+  CompileContext *cx = newCompileContext(NULL, NULL);
+  *tree = NULL;
+  if (cx == NULL)
+    return NULL;
+  useSourceBuffer(cx, text, size);
+  scan(cx);
+  *tree = parse(cx);
+  return cx;
+}
@@ -0,0 +1,29 @@
+/****************************************************/
+/* File: cminus.h                                   */
+/* The library interface of the C- front end,       */
+/* built as libcminus.a                             */
+/****************************************************/
+
+#ifndef _CMINUS_H_
+#define _CMINUS_H_
+#include "globals.h"
+#include "util.h"
+#include "scan.h"
+#include "parse.h"
+#include "intern.h"
+#include "astfile.h"
+#include "incr.h"
+
+/* Function parseBuffer scans and parses the size
+ * characters of text without touching a file. It
+ * returns the context holding the tokens (its
+ * TokenTable), the identifiers (symbolName of its
+ * symbols) and the syntax tree, which is put in
+ * *tree; NULL if out of memory. Nothing is printed:
+ * syntax errors are only counted, in errorCount and
+ * errorLine. text must outlive the context, which
+ * freeCompileContext frees with everything in it
+ */
+CompileContext *parseBuffer(const char *text, size_t size, TreeNode **tree);
+
+#endif
@@ -0,0 +1,287 @@
+/****************************************************/
+/* File: flattree.c                                 */
+/* Compact syntax tree stored in one node array     */
+/****************************************************/
+
+#include "flattree.h"
+#include "util.h"
+#include "arena.h"
+
+/* INITFLAT = initial capacity of each array */
+#define INITFLAT 1024
+
+/* growArray doubles *cap, reallocating *a */
+static void *growArray(void *a, int *cap, size_t size)
+{
+  int n = *cap ? 2 * *cap : INITFLAT;
+  a = realloc(a, n * size);
+  if (a == NULL)
+  {
+    fprintf(stderr, "Out of memory error flattening the syntax tree\n");
+    exit(1);
+  }
+  *cap = n;
+  return a;
+}
+
+void initFlatTree(FlatTree *ft)
+{
+  memset(ft, 0, sizeof(*ft));
+  ft->root = ft->last = NONODE;
+}
+
+/* a Pending is a list still to be copied, from t on:
+   the index of its first node goes to kids[slot], or
+   is returned if slot is NONODE; those after it are
+   linked from node prev */
+typedef struct pending
+{
+  TreeNode *t;
+  int slot;
+  int prev;
+} Pending;
+
+/* PENDING = pending lists held without a malloc */
+#define PENDING 64
+
+/* flattenList appends the list t and its subtrees
+   in preorder, returning the index of t. The lists
+   still to be copied are kept on a stack of its own,
+   so nesting is not limited by the C stack */
+static int flattenList(FlatTree *ft, TreeNode *t)
+{
+  Pending held[PENDING], *stack = held;
+  int top = 0, capacity = PENDING;
+  int first = NONODE;
+  if (t != NULL)
+  {
+    stack[top].t = t;
+    stack[top].slot = stack[top].prev = NONODE;
+    top++;
+  }
+  while (top > 0)
+  {
+    Pending p = stack[--top];
+    int n, i, k, nkids = 0;
+    FlatNode *f;
+    t = p.t;
+    if (ft->count == ft->capacity)
+      ft->nodes = (FlatNode *)growArray(ft->nodes, &ft->capacity, sizeof(FlatNode));
+    n = ft->count++;
+    f = &ft->nodes[n];
+    f->nodekind = (unsigned char)t->nodekind;
+    f->type = (unsigned char)t->type;
+    f->lineno = t->lineno;
+    f->next = NONODE;
+    switch (t->nodekind)
+    {
+    case StmtK:
+      f->kind = (unsigned char)t->kind.stmt;
+      f->type = Integer; /* statements carry no type */
+      f->attr = 0;
+      break;
+    case ExpK:
+      f->kind = (unsigned char)t->kind.exp;
+      f->attr = (t->kind.exp == OpK) ? (int)t->attr.op : t->attr.val;
+      break;
+    default:
+      f->kind = (unsigned char)t->kind.dclr;
+      if (t->kind.dclr == VarArrK)
+      {
+        if (ft->arrayCount == ft->arrayCapacity)
+          ft->arrays = (Array *)growArray(ft->arrays, &ft->arrayCapacity, sizeof(Array));
+        ft->arrays[ft->arrayCount] = *t->attr.arr;
+        f->attr = ft->arrayCount++;
+      }
+      else
+        f->attr = t->attr.name;
+      break;
+    }
+    for (i = 0; i < MAXCHILDREN; i++)
+      if (t->child[i] != NULL)
+        nkids = i + 1;
+    f->nkids = (unsigned char)nkids;
+    f->kids = k = ft->kidCount;
+    while (ft->kidCount + nkids > ft->kidCapacity)
+      ft->kids = (int *)growArray(ft->kids, &ft->kidCapacity, sizeof(int));
+    ft->kidCount += nkids;
+    if (p.prev != NONODE)
+      ft->nodes[p.prev].next = n;
+    else if (p.slot != NONODE)
+      ft->kids[p.slot] = n;
+    else
+      first = n;
+
+    /* the siblings of t come after its children,
+       which come in order */
+    if (top + 1 + nkids > capacity)
+    {
+      Pending *grown;
+      capacity *= 2;
+      grown = (Pending *)malloc(capacity * sizeof(Pending));
+      if (grown == NULL)
+      {
+        fprintf(stderr, "Out of memory error flattening the syntax tree\n");
+        exit(1);
+      }
+      memcpy(grown, stack, top * sizeof(Pending));
+      if (stack != held)
+        free(stack);
+      stack = grown;
+    }
+    if (t->sibling != NULL)
+    {
+      stack[top].t = t->sibling;
+      stack[top].slot = NONODE;
+      stack[top++].prev = n;
+    }
+    for (i = nkids - 1; i >= 0; i--)
+      if (t->child[i] == NULL)
+        ft->kids[k + i] = NONODE;
+      else
+      {
+        stack[top].t = t->child[i];
+        stack[top].slot = k + i;
+        stack[top++].prev = NONODE;
+      }
+  }
+  if (stack != held)
+    free(stack);
+  return first;
+}
+
+int appendFlatTree(FlatTree *ft, TreeNode *t)
+{
+  int n = flattenList(ft, t);
+  if (n == NONODE)
+    return n;
+  if (ft->root == NONODE)
+    ft->root = n;
+  else
+    ft->nodes[ft->last].next = n;
+  for (ft->last = n; ft->nodes[ft->last].next != NONODE; ft->last = ft->nodes[ft->last].next)
+    ;
+  return n;
+}
+
+/* an Expansion is a list still to be rebuilt, from
+   node n on; its first TreeNode goes to *link */
+typedef struct expansion
+{
+  int n;
+  TreeNode **link;
+} Expansion;
+
+/* expandList rebuilds the TreeNode list starting at
+   node n in view; only one node if single is set.
+   Like flattenList it keeps a stack of its own */
+static TreeNode *expandList(FlatTree *ft, Arena *view, int n, int single)
+{
+  Expansion held[PENDING], *stack = held;
+  int top = 0, capacity = PENDING;
+  TreeNode *first = NULL;
+  if (n != NONODE)
+  {
+    stack[top].n = n;
+    stack[top++].link = &first;
+  }
+  while (top > 0)
+  {
+    Expansion e = stack[--top];
+    FlatNode *f = &ft->nodes[e.n];
+    TreeNode *t = (TreeNode *)arenaAlloc(view, sizeof(TreeNode));
+    int i;
+    if (t == NULL)
+    {
+      fprintf(stderr, "Out of memory error printing the syntax tree\n");
+      exit(1);
+    }
+    memset(t, 0, sizeof(*t));
+    t->nodekind = (NodeKind)f->nodekind;
+    t->type = (TypeSpecifier)f->type;
+    t->lineno = f->lineno;
+    switch (t->nodekind)
+    {
+    case StmtK:
+      t->kind.stmt = (StmtKind)f->kind;
+      break;
+    case ExpK:
+      t->kind.exp = (ExpKind)f->kind;
+      if (f->kind == OpK)
+        t->attr.op = (TokenType)f->attr;
+      else
+        t->attr.val = f->attr;
+      break;
+    default:
+      t->kind.dclr = (DclrKind)f->kind;
+      if (f->kind == VarArrK)
+        t->attr.arr = &ft->arrays[f->attr];
+      else
+        t->attr.name = f->attr;
+      break;
+    }
+    *e.link = t;
+
+    if (top + 1 + f->nkids > capacity)
+    {
+      Expansion *grown;
+      capacity *= 2;
+      grown = (Expansion *)malloc(capacity * sizeof(Expansion));
+      if (grown == NULL)
+      {
+        fprintf(stderr, "Out of memory error printing the syntax tree\n");
+        exit(1);
+      }
+      memcpy(grown, stack, top * sizeof(Expansion));
+      if (stack != held)
+        free(stack);
+      stack = grown;
+    }
+    if (!single && f->next != NONODE)
+    {
+      stack[top].n = f->next;
+      stack[top++].link = &t->sibling;
+    }
+    single = FALSE;
+    for (i = f->nkids - 1; i >= 0; i--)
+      if (ft->kids[f->kids + i] != NONODE)
+      {
+        stack[top].n = ft->kids[f->kids + i];
+        stack[top++].link = &t->child[i];
+      }
+  }
+  if (stack != held)
+    free(stack);
+  return first;
+}
+
+void writeFlatTree(TreeWriter *w, FlatTree *ft)
+{
+  /* TreeNodes rebuilt for the writer, one top-level
+     declaration at a time */
+  Arena view = {NULL, NULL, NULL};
+  int n;
+  for (n = ft->root; n != NONODE; n = ft->nodes[n].next)
+  {
+    writeTree(w, expandList(ft, &view, n, TRUE));
+    arenaReset(&view);
+  }
+  arenaRelease(&view);
+}
+
+void printFlatTree(CompileContext *cx, FlatTree *ft)
+{
+  TreeWriter w;
+  startTreeWriter(&w, cx->listing, TextTree, cx->symbols);
+  w.indent = cx->indentno;
+  writeFlatTree(&w, ft);
+  endTreeWriter(&w);
+}
+
+void destroyFlatTree(FlatTree *ft)
+{
+  free(ft->nodes);
+  free(ft->kids);
+  free(ft->arrays);
+  initFlatTree(ft);
+}
@@ -0,0 +1,71 @@
+/****************************************************/
+/* File: flattree.h                                 */
+/* Compact syntax tree stored in one node array     */
+/****************************************************/
+
+#ifndef _FLATTREE_H_
+#define _FLATTREE_H_
+#include "globals.h"
+#include "writer.h"
+
+/* NONODE is the index of "no node" */
+#define NONODE (-1)
+
+/* FlatNode is one node of a FlatTree. Nodes refer to
+ * each other by 32-bit index: next links the nodes of
+ * a list (statements, declarations, arguments) and
+ * the nkids entries of FlatTree.kids from kids on are
+ * the first nodes of the lists that are its children
+ * (child[0], child[1], ... of a TreeNode). Nodes are
+ * stored in preorder, so a subtree is one run of the
+ * array and a pass over every node is a linear scan
+ */
+typedef struct flatNode
+{
+  unsigned char nodekind; /* NodeKind */
+  unsigned char kind;     /* StmtKind, ExpKind or DclrKind */
+  unsigned char type;     /* TypeSpecifier */
+  unsigned char nkids;    /* children, up to the last present */
+  int lineno;
+  /* op, val or name as in TreeNode; for VarArrK the
+     index of its Array in FlatTree.arrays */
+  int attr;
+  int next;
+  int kids;
+} FlatNode;
+
+typedef struct flatTree
+{
+  FlatNode *nodes;
+  int count, capacity;
+  int *kids;
+  int kidCount, kidCapacity;
+  Array *arrays;
+  int arrayCount, arrayCapacity;
+  int root; /* first top-level declaration */
+  int last; /* last top-level declaration */
+} FlatTree;
+
+/* Procedure initFlatTree makes ft an empty tree */
+void initFlatTree(FlatTree *ft);
+
+/* Function appendFlatTree copies the TreeNode list t
+ * to the end of the top-level list of ft; t itself is
+ * left alone. Returns the index of t's first node
+ */
+int appendFlatTree(FlatTree *ft, TreeNode *t);
+
+/* procedure printFlatTree prints ft exactly as
+ * printTree prints the TreeNode tree it came from
+ */
+void printFlatTree(CompileContext *cx, FlatTree *ft);
+
+/* procedure writeFlatTree writes the declarations of
+ * ft with w, as writeTree would those it came from
+ */
+void writeFlatTree(TreeWriter *w, FlatTree *ft);
+
+/* Procedure destroyFlatTree frees ft */
+void destroyFlatTree(FlatTree *ft);
+
+#endif
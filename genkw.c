@@ -0,0 +1,107 @@
+/****************************************************/
+/* File: genkw.c                                    */
+/* Build-time generator of the perfect hash used by */
+/* the scanner to recognize reserved words          */
+/* usage: genkw > kwhash.h                          */
+/****************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+/* the reserved words, straight from keywords.def */
+static struct
+{
+  const char *str;
+  const char *tok;
+} words[] = {
+#define KEYWORD(str, tok) {#str, #tok},
+#include "keywords.def"
+#undef KEYWORD
+};
+
+#define NWORDS ((int)(sizeof(words) / sizeof(words[0])))
+
+/* MAXMUL = largest multiplier tried for each
+   component of the hash */
+#define MAXMUL 32
+
+/* MAXBITS = largest table size tried, as log2 */
+#define MAXBITS 10
+
+/* hash of a word for multipliers a, b, c: keyed on
+   its length and its first and last characters */
+static unsigned int hash(const char *s, unsigned int a, unsigned int b,
+                         unsigned int c, unsigned int mask)
+{
+  unsigned int n = (unsigned int)strlen(s);
+  return (n * a + (unsigned char)s[0] * b + (unsigned char)s[n - 1] * c) & mask;
+}
+
+/* tryHash returns 1 if (a, b, c) sends every word
+   to a different slot of a table of mask+1 entries */
+static int tryHash(unsigned int a, unsigned int b, unsigned int c, unsigned int mask)
+{
+  static char used[1 << MAXBITS];
+  int i;
+  memset(used, 0, mask + 1);
+  for (i = 0; i < NWORDS; i++)
+  {
+    unsigned int h = hash(words[i].str, a, b, c, mask);
+    if (used[h])
+      return 0;
+    used[h] = 1;
+  }
+  return 1;
+}
+
+int main(void)
+{
+  unsigned int bits, a, b, c, mask;
+  int i, minLen = 1 << 30, maxLen = 0;
+  for (i = 0; i < NWORDS; i++)
+  {
+    int n = (int)strlen(words[i].str);
+    if (n < minLen)
+      minLen = n;
+    if (n > maxLen)
+      maxLen = n;
+  }
+  for (bits = 0; (1 << bits) < NWORDS; bits++)
+    ;
+  for (; bits <= MAXBITS; bits++)
+  {
+    mask = (1u << bits) - 1;
+    for (a = 0; a < MAXMUL; a++)
+      for (b = 0; b < MAXMUL; b++)
+        for (c = 0; c < MAXMUL; c++)
+          if (tryHash(a, b, c, mask))
+            goto found;
+  }
+  fprintf(stderr, "genkw: no perfect hash found for keywords.def\n");
+  return 1;
+
+found:
+  printf("/* kwhash.h: generated by genkw from keywords.def, do not edit */\n\n");
+  printf("#ifndef _KWHASH_H_\n#define _KWHASH_H_\n\n");
+  printf("#define KW_MINLEN %d\n", minLen);
+  printf("#define KW_MAXLEN %d\n", maxLen);
+  printf("#define KW_TABLESIZE %u\n\n", mask + 1);
+  printf("/* KWHASH gives the only slot of kwTable the n-character\n");
+  printf(" * word s can occupy; n must be within [KW_MINLEN, KW_MAXLEN]\n */\n");
+  printf("#define KWHASH(s, n) (((unsigned int)(n) * %uu + (unsigned char)(s)[0] * %uu + \\\n", a, b);
+  printf("                   (unsigned char)(s)[(n)-1] * %uu) & %uu)\n\n", c, mask);
+  printf("static const struct\n{\n  const char *str;\n  int len;\n  TokenType tok;\n} kwTable[KW_TABLESIZE] = {\n");
+  for (i = 0; i <= (int)mask; i++)
+  {
+    int j;
+    for (j = 0; j < NWORDS; j++)
+      if (hash(words[j].str, a, b, c, mask) == (unsigned int)i)
+        break;
+    if (j < NWORDS)
+      printf("    {\"%s\", %d, %s},\n", words[j].str, (int)strlen(words[j].str), words[j].tok);
+    else
+      printf("    {\"\", 0, ID},\n");
+  }
+  printf("};\n\n#endif\n");
+  return 0;
+}
@@ -0,0 +1,512 @@
+/****************************************************/
+/* File: genll.c                                    */
+/* Build-time generator of the LL(1) parse table    */
+/* usage: genll grammar.ll > lltab.h                */
+/* computes the FIRST and FOLLOW sets of the        */
+/* grammar as bitsets over the tokens and emits the */
+/* productions, the parse table and the sets for   */
+/* the table-driven parser of parse.c               */
+/****************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAXNAMES 256   /* of each kind of symbol */
+#define MAXPRODS 512
+#define MAXSYMS 4096   /* in all right-hand sides */
+#define MAXWORD 64
+
+/* a set of terminals; bit i is terminal i */
+typedef unsigned long long Set;
+
+/* symbol codes inside the generator */
+#define TERM(i) (i)
+#define NONTERM(i) (MAXNAMES + (i))
+#define ACTION(i) (2 * MAXNAMES + (i))
+#define ISTERM(s) ((s) < MAXNAMES)
+#define ISNONTERM(s) ((s) >= MAXNAMES && (s) < 2 * MAXNAMES)
+#define ISACTION(s) ((s) >= 2 * MAXNAMES)
+
+static char terms[MAXNAMES][MAXWORD];
+static int termCount = 0;
+static char nonterms[MAXNAMES][MAXWORD];
+static int nontermDefined[MAXNAMES];
+static int nontermCount = 0;
+static char actions[MAXNAMES][MAXWORD];
+static int actionYield[MAXNAMES];
+static int actionCount = 0;
+
+static int prodLhs[MAXPRODS];
+static int prodStart[MAXPRODS + 1];
+static int prodCount = 0;
+static int rhs[MAXSYMS];
+static int rhsCount = 0;
+
+static Set first[MAXNAMES];
+static Set follow[MAXNAMES];
+static int nullable[MAXNAMES];
+static int yield[MAXNAMES];
+static int yieldKnown[MAXNAMES];
+static int table[MAXNAMES][MAXNAMES]; /* 1 + production, 0 if none */
+
+static int errors = 0;
+
+static int lookup(char names[][MAXWORD], int *count, const char *w)
+{
+  int i;
+  for (i = 0; i < *count; i++)
+    if (strcmp(names[i], w) == 0)
+      return i;
+  if (*count == MAXNAMES)
+  {
+    fprintf(stderr, "genll: too many names\n");
+    exit(1);
+  }
+  strcpy(names[*count], w);
+  return (*count)++;
+}
+
+/* readWord reads the next word of the grammar,
+   skipping white space and # comments */
+static int readWord(FILE *f, char *w)
+{
+  int c, n = 0;
+  for (;;)
+  {
+    while ((c = getc(f)) != EOF && isspace(c))
+      ;
+    if (c != '#')
+      break;
+    while ((c = getc(f)) != EOF && c != '\n')
+      ;
+  }
+  if (c == EOF)
+    return 0;
+  while (c != EOF && !isspace(c) && n < MAXWORD - 1)
+  {
+    w[n++] = (char)c;
+    c = getc(f);
+  }
+  w[n] = '\0';
+  return 1;
+}
+
+/* readGrammar reads the grammar into the
+   production arrays */
+static void readGrammar(FILE *f)
+{
+  static char words[MAXSYMS][MAXWORD];
+  int n = 0, i, lhs = -1;
+  while (n < MAXSYMS && readWord(f, words[n]))
+    n++;
+  for (i = 0; i < n; i++)
+  {
+    char *w = words[i];
+    if (strcmp(w, "%action") == 0 && i + 2 < n)
+    {
+      int a = lookup(actions, &actionCount, words[i + 1]);
+      actionYield[a] = atoi(words[i + 2]);
+      i += 2;
+    }
+    else if (i + 1 < n && strcmp(words[i + 1], "->") == 0)
+    {
+      lhs = lookup(nonterms, &nontermCount, w);
+      if (nontermDefined[lhs])
+      {
+        fprintf(stderr, "genll: %s defined twice\n", w);
+        errors++;
+      }
+      nontermDefined[lhs] = 1;
+      prodLhs[prodCount] = lhs;
+      prodStart[prodCount++] = rhsCount;
+      i++;
+    }
+    else if (lhs < 0)
+    {
+      fprintf(stderr, "genll: %s before the first production\n", w);
+      errors++;
+    }
+    else if (strcmp(w, "|") == 0)
+    {
+      prodLhs[prodCount] = lhs;
+      prodStart[prodCount++] = rhsCount;
+    }
+    else if (w[0] == '@')
+    {
+      int count = actionCount;
+      int a = lookup(actions, &actionCount, w + 1);
+      if (a == count)
+      {
+        fprintf(stderr, "genll: action %s is not declared\n", w);
+        errors++;
+      }
+      rhs[rhsCount++] = ACTION(a);
+    }
+    else if (isupper((unsigned char)w[0]))
+      rhs[rhsCount++] = TERM(lookup(terms, &termCount, w));
+    else
+      rhs[rhsCount++] = NONTERM(lookup(nonterms, &nontermCount, w));
+    if (prodCount == MAXPRODS || rhsCount == MAXSYMS)
+    {
+      fprintf(stderr, "genll: grammar too large\n");
+      exit(1);
+    }
+  }
+  prodStart[prodCount] = rhsCount;
+  for (i = 0; i < nontermCount; i++)
+    if (!nontermDefined[i])
+    {
+      fprintf(stderr, "genll: %s is used but not defined\n", nonterms[i]);
+      errors++;
+    }
+}
+
+/* firstOf gives the FIRST set of rhs[from..to), and
+   in *empty whether it can derive nothing */
+static Set firstOf(int from, int to, int *empty)
+{
+  Set s = 0;
+  for (; from < to; from++)
+  {
+    int x = rhs[from];
+    if (ISTERM(x))
+    {
+      *empty = 0;
+      return s | (1ull << x);
+    }
+    if (ISNONTERM(x))
+    {
+      s |= first[x - MAXNAMES];
+      if (!nullable[x - MAXNAMES])
+      {
+        *empty = 0;
+        return s;
+      }
+    }
+  }
+  *empty = 1;
+  return s;
+}
+
+/* computeSets computes nullable, FIRST and FOLLOW
+   as fixed points */
+static void computeSets(int endfile)
+{
+  int changed, p, i;
+  do
+  {
+    changed = 0;
+    for (p = 0; p < prodCount; p++)
+    {
+      int a = prodLhs[p], empty;
+      Set s = firstOf(prodStart[p], prodStart[p + 1], &empty);
+      if ((s | first[a]) != first[a] || (empty && !nullable[a]))
+      {
+        first[a] |= s;
+        nullable[a] |= empty;
+        changed = 1;
+      }
+    }
+  } while (changed);
+  follow[0] = 1ull << endfile;
+  do
+  {
+    changed = 0;
+    for (p = 0; p < prodCount; p++)
+      for (i = prodStart[p]; i < prodStart[p + 1]; i++)
+        if (ISNONTERM(rhs[i]))
+        {
+          int b = rhs[i] - MAXNAMES, empty;
+          Set s = firstOf(i + 1, prodStart[p + 1], &empty);
+          if (empty)
+            s |= follow[prodLhs[p]];
+          if ((s | follow[b]) != follow[b])
+          {
+            follow[b] |= s;
+            changed = 1;
+          }
+        }
+  } while (changed);
+}
+
+/* computeTable fills the parse table. A token in
+   both the FIRST set of one alternative and the
+   FOLLOW set of an empty one goes to the first,
+   which resolves the dangling else */
+static void computeTable(void)
+{
+  int p, t, empty;
+  for (p = 0; p < prodCount; p++)
+  {
+    int a = prodLhs[p];
+    Set s = firstOf(prodStart[p], prodStart[p + 1], &empty);
+    for (t = 0; t < termCount; t++)
+      if (s & (1ull << t))
+      {
+        if (table[a][t])
+        {
+          fprintf(stderr, "genll: %s is not LL(1): two alternatives start with %s\n",
+                  nonterms[a], terms[t]);
+          errors++;
+        }
+        table[a][t] = p + 1;
+      }
+  }
+  for (p = 0; p < prodCount; p++)
+  {
+    int a = prodLhs[p];
+    firstOf(prodStart[p], prodStart[p + 1], &empty);
+    if (!empty)
+      continue;
+    for (t = 0; t < termCount; t++)
+      if (follow[a] & (1ull << t))
+      {
+        if (table[a][t] == 0)
+          table[a][t] = p + 1;
+        else if (firstOf(prodStart[table[a][t] - 1], prodStart[table[a][t]], &empty), empty)
+        {
+          fprintf(stderr, "genll: %s is not LL(1): two empty alternatives\n", nonterms[a]);
+          errors++;
+        }
+      }
+  }
+}
+
+/* computeYields works out how many entries each
+   nonterminal adds to the value stack, which must be
+   the same for all its alternatives */
+static void computeYields(void)
+{
+  int changed, p, i;
+  do
+  {
+    changed = 0;
+    for (p = 0; p < prodCount; p++)
+    {
+      int a = prodLhs[p], n = 0, known = 1;
+      if (yieldKnown[a])
+        continue;
+      for (i = prodStart[p]; i < prodStart[p + 1]; i++)
+        if (ISNONTERM(rhs[i]))
+        {
+          known &= yieldKnown[rhs[i] - MAXNAMES];
+          n += yield[rhs[i] - MAXNAMES];
+        }
+        else if (!ISTERM(rhs[i]))
+          n += actionYield[rhs[i] - 2 * MAXNAMES];
+      if (known)
+      {
+        yield[a] = n;
+        yieldKnown[a] = changed = 1;
+      }
+    }
+  } while (changed);
+  for (p = 0; p < prodCount; p++)
+  {
+    int a = prodLhs[p], n = 0;
+    for (i = prodStart[p]; i < prodStart[p + 1]; i++)
+      if (ISNONTERM(rhs[i]))
+        n += yield[rhs[i] - MAXNAMES];
+      else if (!ISTERM(rhs[i]))
+        n += actionYield[rhs[i] - 2 * MAXNAMES];
+    if (!yieldKnown[a] || n != yield[a])
+    {
+      fprintf(stderr, "genll: the alternatives of %s leave different values\n", nonterms[a]);
+      errors++;
+      yieldKnown[a] = 1;
+      yield[a] = n;
+    }
+  }
+}
+
+static void printSet(Set s)
+{
+  int t, any = 0;
+  for (t = 0; t < termCount; t++)
+    if (s & (1ull << t))
+      printf("%sTOKBIT(%s)", any++ ? " | " : "", terms[t]);
+  if (!any)
+    printf("0");
+}
+
+/* predict leaves in predicted, last symbol first, the
+   symbols left by expanding nonterminal a on token t and
+   then whatever nonterminal comes on top, until a token
+   does or none is left, and returns how many there are.
+   Actions are left out. The table is LL(1), so each
+   expansion it makes is the one the parser would */
+static int predicted[MAXSYMS];
+static int predict(int a, int t)
+{
+  int n = 0, i, x, p;
+  predicted[n++] = NONTERM(a);
+  while (n > 0 && ISNONTERM(predicted[n - 1]))
+  {
+    x = predicted[--n] - MAXNAMES;
+    p = table[x][t] - 1;
+    if (p < 0)
+    {
+      fprintf(stderr, "genll: %s has no production for %s\n", nonterms[x], terms[t]);
+      exit(1);
+    }
+    for (i = prodStart[p + 1] - 1; i >= prodStart[p]; i--)
+      if (!ISACTION(rhs[i]))
+      {
+        if (n == MAXSYMS)
+        {
+          fprintf(stderr, "genll: prediction of %s too long\n", nonterms[a]);
+          exit(1);
+        }
+        predicted[n++] = rhs[i];
+      }
+  }
+  return n;
+}
+
+int main(int argc, char *argv[])
+{
+  FILE *f;
+  int i, p, t, n, endfile;
+  if (argc != 2 || (f = fopen(argv[1], "r")) == NULL)
+  {
+    fprintf(stderr, "usage: genll grammar.ll > lltab.h\n");
+    return 1;
+  }
+  readGrammar(f);
+  fclose(f);
+  endfile = lookup(terms, &termCount, "ENDFILE");
+  if (errors || prodCount == 0)
+    return 1;
+  if (termCount > 64)
+  {
+    fprintf(stderr, "genll: more than 64 terminals\n");
+    return 1;
+  }
+  computeSets(endfile);
+  computeTable();
+  computeYields();
+  if (errors)
+    return 1;
+
+  printf("/* lltab.h: generated by genll from grammar.ll, do not edit */\n\n");
+  printf("#ifndef _LLTAB_H_\n#define _LLTAB_H_\n\n");
+  printf("/* symbols of the right-hand sides: TokenTypes, then\n");
+  printf(" * nonterminals from LL_NT on and actions from LL_ACT on\n */\n");
+  printf("#define LL_NT 256\n#define LL_ACT 512\n\n");
+  printf("enum\n{\n");
+  for (i = 0; i < nontermCount; i++)
+    printf("  NT_%s,\n", nonterms[i]);
+  printf("  LL_NONTERMINALS\n};\n\n");
+  printf("enum\n{\n");
+  for (i = 0; i < actionCount; i++)
+    printf("  ACT_%s,\n", actions[i]);
+  printf("  LL_ACTIONS\n};\n\n");
+
+  printf("/* production p is llRhs[llRhsStart[p] .. llRhsStart[p + 1]) */\n");
+  printf("static const short llRhs[] = {");
+  for (i = 0; i < rhsCount; i++)
+  {
+    int x = rhs[i];
+    printf("%s", (i % 6 == 0) ? "\n    " : " ");
+    if (ISTERM(x))
+      printf("%s,", terms[x]);
+    else if (ISNONTERM(x))
+      printf("LL_NT + NT_%s,", nonterms[x - MAXNAMES]);
+    else
+      printf("LL_ACT + ACT_%s,", actions[x - 2 * MAXNAMES]);
+  }
+  printf("\n    0};\n\n");
+  printf("static const short llRhsStart[] = {");
+  for (p = 0; p <= prodCount; p++)
+    printf("%s%d,", (p % 12 == 0) ? "\n    " : " ", prodStart[p]);
+  printf("\n};\n\n");
+
+  printf("/* expanding nonterminal n on token t, and then each\n");
+  printf(" * nonterminal that comes on top, until a token does or\n");
+  printf(" * nothing is left, pushes the symbols of entry\n");
+  printf(" * llPredict[n][t] - 1 of llPredicted, without actions\n");
+  printf(" * and last symbol first: llPredicted[llPredictedStart[e]\n");
+  printf(" * .. llPredictedStart[e + 1]). 0 if n has no production\n");
+  printf(" * for t */\n");
+  printf("static const unsigned short llPredict[LL_NONTERMINALS][NTOKENTYPES] = {\n");
+  for (i = 0, n = 0; i < nontermCount; i++)
+  {
+    int any = 0;
+    printf("    /* %s */ {", nonterms[i]);
+    for (t = 0; t < termCount; t++)
+      if (table[i][t])
+        printf("%s[%s] = %d", any++ ? ", " : "", terms[t], ++n);
+    printf("},\n");
+  }
+  printf("};\n\n");
+  printf("static const short llPredicted[] = {");
+  for (i = 0, n = 0; i < nontermCount; i++)
+    for (t = 0; t < termCount; t++)
+      if (table[i][t])
+      {
+        int len = predict(i, t);
+        for (p = 0; p < len; p++)
+        {
+          int x = predicted[p];
+          printf("%s", (n++ % 6 == 0) ? "\n    " : " ");
+          if (ISTERM(x))
+            printf("%s,", terms[x]);
+          else
+            printf("LL_NT + NT_%s,", nonterms[x - MAXNAMES]);
+        }
+      }
+  printf("\n    0};\n\n");
+  printf("static const unsigned short llPredictedStart[] = {");
+  for (i = 0, n = 0, p = 0; i < nontermCount; i++)
+    for (t = 0; t < termCount; t++)
+      if (table[i][t])
+      {
+        printf("%s%d,", (p++ % 12 == 0) ? "\n    " : " ", n);
+        n += predict(i, t);
+      }
+  printf("%s%d,\n};\n\n", (p % 12 == 0) ? "\n    " : " ", n);
+  printf("/* llTable[n][t] is 1 + the production nonterminal n\n");
+  printf(" * expands to when the next token is t, 0 if none\n */\n");
+  printf("static const unsigned short llTable[LL_NONTERMINALS][NTOKENTYPES] = {\n");
+  for (i = 0; i < nontermCount; i++)
+  {
+    int any = 0;
+    printf("    /* %s */ {", nonterms[i]);
+    for (t = 0; t < termCount; t++)
+      if (table[i][t])
+        printf("%s[%s] = %d", any++ ? ", " : "", terms[t], table[i][t]);
+    printf("},\n");
+  }
+  printf("};\n\n");
+
+  printf("/* FIRST and FOLLOW of each nonterminal, as sets of\n");
+  printf(" * TOKBIT(t)\n */\n");
+  printf("#define TOKBIT(t) (1ull << (t))\n");
+  printf("typedef char llTokenSetsFit[NTOKENTYPES <= 64 ? 1 : -1];\n\n");
+  printf("static const unsigned long long llFirst[LL_NONTERMINALS] = {\n");
+  for (i = 0; i < nontermCount; i++)
+  {
+    printf("    /* %s */ ", nonterms[i]);
+    printSet(first[i]);
+    printf(",\n");
+  }
+  printf("};\n\n");
+  printf("static const unsigned long long llFollow[LL_NONTERMINALS] = {\n");
+  for (i = 0; i < nontermCount; i++)
+  {
+    printf("    /* %s */ ", nonterms[i]);
+    printSet(follow[i]);
+    printf(",\n");
+  }
+  printf("};\n\n");
+  printf("/* llYield[n] is the number of entries the actions of a\n");
+  printf(" * production of n add to the value stack\n */\n");
+  printf("static const signed char llYield[LL_NONTERMINALS] = {");
+  for (i = 0; i < nontermCount; i++)
+    printf("%s%d,", (i % 16 == 0) ? "\n    " : " ", yield[i]);
+  printf("\n};\n\n");
+  printf("#endif\n");
+  return 0;
+}
@@ -0,0 +1,121 @@
+/****************************************************/
+/* File: genscan.c                                  */
+/* Build-time generator of the scanner tables       */
+/* usage: genscan > scantab.h                       */
+/* reads the token specification in tokens.def and  */
+/* emits the 256-entry character class and symbol   */
+/* tables getToken dispatches on                    */
+/****************************************************/
+
+#include <stdio.h>
+
+/* character classes, see scantab.h */
+static const char *className[] = {
+    "CC_OTHER", "CC_SPACE", "CC_LETTER", "CC_DIGIT", "CC_SYMBOL", "CC_SYMBOL2"};
+
+enum
+{
+  CC_OTHER,
+  CC_SPACE,
+  CC_LETTER,
+  CC_DIGIT,
+  CC_SYMBOL,
+  CC_SYMBOL2,
+  NCLASSES
+};
+
+static int charClass[256];
+static const char *symbolToken[256];
+static int symbolSecond[256];
+static const char *symbolPair[256];
+
+/* define reports a character given two meanings
+   by tokens.def */
+static int define(int c, int cls)
+{
+  if (charClass[c] != CC_OTHER)
+  {
+    fprintf(stderr, "genscan: character %d specified twice in tokens.def\n", c);
+    return 1;
+  }
+  charClass[c] = cls;
+  return 0;
+}
+
+/* printTable prints one 256-entry table; row holds
+   the spelling of each entry */
+static void printTable(const char *type, const char *name, const char *row[256])
+{
+  int i;
+  printf("static const %s %s[256] = {", type, name);
+  for (i = 0; i < 256; i++)
+    printf("%s%s,", (i % 8 == 0) ? "\n    " : " ", row[i]);
+  printf("\n};\n\n");
+}
+
+int main(void)
+{
+  static char numbers[256][8];
+  const char *row[256];
+  int i, c, errors = 0;
+
+  for (i = 0; i < 256; i++)
+  {
+    charClass[i] = CC_OTHER;
+    symbolToken[i] = "ERROR";
+    symbolSecond[i] = 0;
+    symbolPair[i] = "ERROR";
+    sprintf(numbers[i], "%d", i);
+  }
+
+#define SPACE(ch) errors += define((unsigned char)(ch), CC_SPACE);
+#define LETTERS(lo, hi)     \
+  for (c = lo; c <= hi; c++) \
+    errors += define(c, CC_LETTER);
+#define DIGITS(lo, hi)      \
+  for (c = lo; c <= hi; c++) \
+    errors += define(c, CC_DIGIT);
+#define SYMBOL(ch, tok)                             \
+  errors += define((unsigned char)(ch), CC_SYMBOL); \
+  symbolToken[(unsigned char)(ch)] = #tok;
+#define SYMBOL2(ch, ch2, tok, single)                \
+  errors += define((unsigned char)(ch), CC_SYMBOL2); \
+  symbolToken[(unsigned char)(ch)] = #single;        \
+  symbolSecond[(unsigned char)(ch)] = (ch2);         \
+  symbolPair[(unsigned char)(ch)] = #tok;
+#include "tokens.def"
+#undef SPACE
+#undef LETTERS
+#undef DIGITS
+#undef SYMBOL
+#undef SYMBOL2
+
+  if (errors)
+    return 1;
+
+  printf("/* scantab.h: generated by genscan from tokens.def, do not edit */\n\n");
+  printf("#ifndef _SCANTAB_H_\n#define _SCANTAB_H_\n\n");
+  printf("/* character classes */\n");
+  for (i = 0; i < NCLASSES; i++)
+    printf("#define %s %d\n", className[i], i);
+  printf("\n");
+
+  printf("/* charClass gives the class of every character */\n");
+  for (i = 0; i < 256; i++)
+    row[i] = className[charClass[i]];
+  printTable("unsigned char", "charClass", row);
+
+  printf("/* symbolToken gives the token of a CC_SYMBOL character, or\n");
+  printf(" * of a CC_SYMBOL2 character that is not followed by symbolSecond\n */\n");
+  printTable("TokenType", "symbolToken", symbolToken);
+
+  printf("/* symbolSecond gives the character that turns a CC_SYMBOL2\n");
+  printf(" * character into the two-character token symbolPair\n */\n");
+  for (i = 0; i < 256; i++)
+    row[i] = numbers[symbolSecond[i]];
+  printTable("unsigned char", "symbolSecond", row);
+  printTable("TokenType", "symbolPair", symbolPair);
+
+  printf("#endif\n");
+  return 0;
+}
@@ -23,10 +23,6 @@
 #define TRUE 1
 #endif
 
-/* MAXRESERVED = the number of reserved words */
-// TODO: 把 maxreserved 改为c-的保留字个数.
-#define MAXRESERVED 6
-
 #define MAXTOKENLEN 40
 
 // TODO: 修改下面的 reserved words and special symbols
@@ -36,13 +32,10 @@ typedef enum
   ENDFILE,
   ERROR,
   ERRORENDFILE,
-  /* reserved words */
-  IF,
-  ELSE,
-  INT,
-  RETURN,
-  VOID,
-  WHILE,
+  /* reserved words, see keywords.def */
+#define KEYWORD(str, tok) tok,
+#include "keywords.def"
+#undef KEYWORD
   /* multicharacter tokens */
   ID,
   NUM,
@@ -69,22 +62,71 @@ typedef enum
   EQ,
 } TokenType;
 
-typedef struct tokenNode {
-  TokenType type;
-  int lineno;
-  char* tokenString;
-  struct tokenNode* next;
-  struct tokenNode* pre;
-} TokenNode;
-
-extern TokenNode *TokenTable;
-
-extern FILE *source;  /* source code text file */
-extern FILE *listing; /* listing output text file */
-extern FILE *code;    /* code text file for TM simulator */
-
-
-extern int lineno; /* source line number for listing */
+/* number of TokenTypes; EQ must stay the last one */
+#define NTOKENTYPES (EQ + 1)
+
+/* TokenStore holds the token stream as parallel arrays.
+ * Tokens are numbered from 0 in scan order; token i lives
+ * in slot TOKENSLOT(i) of each array. The lexeme of a
+ * token is not copied: it is the span of len characters
+ * at offset in the scanner's source buffer. attr is the
+ * interned symbol id of an ID token and the value of a
+ * NUM token.
+ * scan() keeps every token (first stays 0); when the
+ * parser pulls tokens with getNextToken the arrays are a
+ * ring holding only tokens first..count-1. A streamed
+ * source may run past 4 GiB and 2^31 tokens, so offsets
+ * and token numbers are 64 bits; a table that holds
+ * every token is limited to MAXTOKENS of them
+ */
+typedef struct tokenStore {
+  TokenType *type;
+  int *lineno;
+  size_t *offset;
+  unsigned int *len;
+  int *attr;
+  long long first; /* oldest token still held */
+  long long count; /* number of tokens scanned so far */
+  int capacity;    /* number of slots, a power of two */
+} TokenStore;
+
+/* MAXTOKENS = most slots a TokenStore may have */
+#define MAXTOKENS (1 << 30)
+
+/* CompileContext holds everything the front end
+ * changes while compiling one file, so several files
+ * can be compiled at once, one context each. The
+ * scanner, the symbols and the syntax tree nodes are
+ * kept by scan.c, intern.c and util.c behind the
+ * pointers at the end; newCompileContext (util.h)
+ * makes a context and freeCompileContext frees it
+ */
+typedef struct compileContext {
+  FILE *source;  /* source code text file */
+  FILE *listing; /* listing output text file, or NULL for none */
+  FILE *code;    /* code text file for TM simulator */
+  int lineno;    /* source line number for listing */
+  /* Error = TRUE prevents further passes if an error occurs;
+     errorCount syntax errors were found, the first on line
+     errorLine. With no listing they are only counted */
+  int Error;
+  int errorCount;
+  int errorLine;
+  TokenStore TokenTable; /* token stream built by scan() */
+  /* lexeme of the last token when TraceScan is set */
+  char tokenString[MAXTOKENLEN + 1];
+  int indentno; /* current indentation of printTree */
+  struct scanner *scanner;
+  struct internTable *symbols;
+  struct arena *nodes;
+} CompileContext;
+
+/* slot, type, line number and attribute of token i
+   of the TokenTable of context cx */
+#define TOKENSLOT(cx, i) ((i) & ((cx)->TokenTable.capacity - 1))
+#define TOKENTYPE(cx, i) ((cx)->TokenTable.type[TOKENSLOT(cx, i)])
+#define TOKENLINE(cx, i) ((cx)->TokenTable.lineno[TOKENSLOT(cx, i)])
+#define TOKENATTR(cx, i) ((cx)->TokenTable.attr[TOKENSLOT(cx, i)])
 
 // todo: modify the data struct to fit c-minus
 /**************************************************/
@@ -133,7 +175,7 @@ typedef enum
 #define MAXCHILDREN 3
 
 typedef struct array{
-  char name[MAXTOKENLEN + 1];
+  int name; // 数组名的符号 id
   unsigned int len;
 } Array;
 
@@ -151,7 +193,7 @@ typedef struct treeNode
   union {
     TokenType op;// 如果是操作节点
     int val; // 如果是常数节点
-    char *name;// 如果是id 或者函数节点
+    int name;// 如果是id 或者函数节点, 为符号 id
     Array* arr;// 如果是数组节点
   } attr;
   int index;
@@ -162,6 +204,9 @@ typedef struct treeNode
 /**************************************************/
 /***********   Flags for tracing       ************/
 /**************************************************/
+/* the flags are shared by every CompileContext and
+ * only read while compiling
+ */
 
 /* EchoSource = TRUE causes the source program to
  * be echoed to the listing file with line numbers
@@ -190,7 +235,4 @@ extern int TraceAnalyze;
  * to the TM code file as code is generated
  */
 extern int TraceCode;
-
-/* Error = TRUE prevents further passes if an error occurs */
-extern int Error;
 #endif
@@ -0,0 +1,138 @@
+####################################################
+# File: grammar.ll                                 #
+# LL(1) grammar of C- for the table-driven parser  #
+# genll computes FIRST and FOLLOW from it and      #
+# emits the parse table of lltab.h                 #
+####################################################
+
+# lhs -> symbols | symbols ...   an empty alternative derives nothing
+# UPPER CASE names are TokenTypes, lower case ones nonterminals and
+# @name a semantic action of parse.c, run when the parser reaches it.
+# The first nonterminal is the start symbol.
+#
+# %action name n   declares an action that adds n entries to the
+# parser's value stack (n < 0 removes them)
+
+%action list 1        # push an empty list
+%action append -1     # pop a node onto the end of the list below it
+%action int 1         # push the type of the INT just matched
+%action void 1        # push the type of the VOID just matched
+%action name 1        # push the symbol of the ID just matched
+%action var -1        # type name -> variable declaration
+%action vararr -1     # type name -> array declaration, length the NUM just matched
+%action parr -1       # type name -> array parameter
+%action noparam 0     # type -> the (void) parameter list
+%action fun -3        # type name params body -> function declaration
+%action compound 1    # push a compound statement
+%action if 1          # push an if statement
+%action while 1       # push a while statement
+%action return 1      # push a return statement
+%action kid0 -1       # pop a node into child[0] of the node below it
+%action kid1 -1       # ... child[1]
+%action kid2 -1       # ... child[2]
+%action id 1          # push a variable, the ID just matched
+%action sub 0         # make the variable on top a subscript
+%action call 0        # make the variable on top a call
+%action const 1       # push a constant, the NUM just matched
+%action chain 0       # start an operator chain: see binops
+%action op -1         # left operand -> operator, the one just matched
+%action fold 0        # end the chain: its operand -> the whole of it
+%action assign 0      # target -> assignment to it
+
+program -> @list declaration_list
+
+declaration_list -> declaration @append declaration_list
+                  |
+
+declaration -> type_specifier ID @name declaration2
+
+declaration2 -> var_tail
+              | LPAREN @list params RPAREN compound_stmt @fun
+
+var_declaration -> type_specifier ID @name var_tail
+
+var_tail -> @var SEMI
+          | LBRACKET NUM @vararr RBRACKET SEMI
+
+type_specifier -> INT @int | VOID @void
+
+# "void" alone is an empty parameter list, "void x" a parameter
+params -> INT @int ID @name param2 @append param_list
+        | VOID @void params2
+
+params2 -> @noparam @append
+         | ID @name param2 @append param_list
+
+param_list -> COMMA param @append param_list
+            |
+
+param -> type_specifier ID @name param2
+
+param2 -> @var | LBRACKET @parr RBRACKET
+
+compound_stmt -> @compound LBRACE @list local_declarations @kid0 @list statement_list @kid1 RBRACE
+
+local_declarations -> var_declaration @append local_declarations
+                    |
+
+statement_list -> statement @append statement_list
+                |
+
+statement -> expression_stmt | compound_stmt | selection_stmt
+           | iteration_stmt | return_stmt
+
+expression_stmt -> expression SEMI
+
+# an else belongs to the nearest if: genll prefers ELSE over the
+# empty alternative
+selection_stmt -> @if IF LPAREN expression @kid0 RPAREN statement @kid1 selection_stmt2
+
+selection_stmt2 -> ELSE statement @kid2
+                 |
+
+iteration_stmt -> @while WHILE LPAREN expression @kid0 RPAREN statement @kid1
+
+return_stmt -> @return RETURN return_stmt2 SEMI
+
+return_stmt2 -> expression @kid0
+              |
+
+# expression -> var = expression | simple_expression, left factored:
+# whether a variable is assigned to is known only after it is parsed
+expression -> ID @id expression2
+            | NUM @const operators
+            | LPAREN expression RPAREN operators
+
+expression2 -> @assign ASSIGN expression @kid1
+             | LBRACKET @sub expression @kid0 RBRACKET expression3
+             | LPAREN @call @list args @kid0 RPAREN operators
+             | operators
+
+expression3 -> @assign ASSIGN expression @kid1
+             | operators
+
+# the operators following the first factor of a simple expression.
+# Their precedence is not spelled out in the grammar: @op and @fold
+# climb the bindingPower of parse.c, holding each operator until the
+# one after it is known not to bind tighter
+operators -> @chain binop @op factor binops @fold
+           |
+
+binops -> binop @op factor binops
+        |
+
+binop -> LE | LT | GT | GE | EQ | NE | PLUS | SUB | MUL | DIV
+
+factor -> LPAREN expression RPAREN
+        | NUM @const
+        | ID @id factor2
+
+factor2 -> LBRACKET @sub expression @kid0 RBRACKET
+         | LPAREN @call @list args @kid0 RPAREN
+         |
+
+args -> expression @append arg_list
+      |
+
+arg_list -> COMMA expression @append arg_list
+          |
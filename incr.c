@@ -0,0 +1,253 @@
+/****************************************************/
+/* File: incr.c                                     */
+/* Incremental parsing: keeping the tokens and the  */
+/* syntax tree of a source up to date as it is      */
+/* edited                                           */
+/****************************************************/
+
+#include "incr.h"
+#include "util.h"
+#include "scan.h"
+#include "parse.h"
+
+/* reserveDecls makes room in l for n entries plus
+   where the last one ends */
+static void reserveDecls(DeclList *l, int n)
+{
+  int cap = l->capacity ? l->capacity : 64;
+  if (n + 1 <= l->capacity)
+    return;
+  while (cap < n + 1)
+    cap *= 2;
+  l->decls = (TreeNode **)realloc(l->decls, cap * sizeof(TreeNode *));
+  l->starts = (int *)realloc(l->starts, cap * sizeof(int));
+  l->lineShift = (int *)realloc(l->lineShift, cap * sizeof(int));
+  if (l->decls == NULL || l->starts == NULL || l->lineShift == NULL)
+  {
+    fprintf(stderr, "Out of memory error keeping the declarations\n");
+    exit(1);
+  }
+  l->capacity = cap;
+}
+
+static void freeDecls(DeclList *l)
+{
+  free(l->decls);
+  free(l->starts);
+  free(l->lineShift);
+  memset(l, 0, sizeof(DeclList));
+}
+
+/* findEntry returns the first entry of l starting
+   at or after token t, count if there is none */
+static int findEntry(const DeclList *l, int t)
+{
+  int lo = 0, hi = l->count;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (l->starts[mid] < t)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* Reparse is the state of a run of entries being
+   parsed again: they are collected in fresh until
+   they fall in step with the old ones at resume */
+typedef struct reparse
+{
+  const DeclList *old;
+  DeclList fresh;
+  int holes;   /* NULL entries in fresh */
+  int newEnd;  /* first token past those relexEdit made */
+  int shift;   /* how far the old tokens past them moved */
+  int resume;  /* old entry to go on with, or -1 */
+} Reparse;
+
+/* reparsed is the parseDeclarations callback that
+   collects the entries. A declaration ending where
+   an old entry past the edit starts ends the run, as
+   does a hole reaching one: the old entries from
+   there on parse as they did */
+static int reparsed(void *arg, int begin, int end, TreeNode *decl)
+{
+  Reparse *r = (Reparse *)arg;
+  DeclList *l = &r->fresh;
+  int i;
+  reserveDecls(l, l->count + 1);
+  l->decls[l->count] = decl;
+  l->starts[l->count] = begin;
+  l->lineShift[l->count] = 0;
+  l->count++;
+  l->starts[l->count] = end;
+  if (decl == NULL)
+  {
+    r->holes++;
+    i = findEntry(r->old, (end > r->newEnd ? end : r->newEnd) - r->shift);
+    if (i < r->old->count)
+      r->resume = i;
+  }
+  else if (end >= r->newEnd)
+  {
+    i = findEntry(r->old, end - r->shift);
+    if (i < r->old->count && r->old->starts[i] == end - r->shift)
+      r->resume = i;
+  }
+  return r->resume >= 0;
+}
+
+/* parseEntries parses entries into r from token
+   begin, going on past each hole, until they fall in
+   step with the old ones or the file ends */
+static void parseEntries(CompileContext *cx, Reparse *r, int begin)
+{
+  r->resume = -1;
+  while (!parseDeclarations(cx, begin, reparsed, r) && r->resume < 0)
+    begin = r->fresh.starts[r->fresh.count];
+}
+
+/* linkDecls makes entries from up to to of l the
+   siblings of the declarations before them */
+static void linkDecls(DeclList *l, int from, int to)
+{
+  int i;
+  if (from < 1)
+    from = 1;
+  for (i = from; i <= to && i <= l->count; i++)
+    if (l->decls[i - 1] != NULL)
+      l->decls[i - 1]->sibling = (i < l->count) ? l->decls[i] : NULL;
+}
+
+/* fullParse parses the whole source again */
+static int fullParse(IncrementalParse *ip)
+{
+  DeclList none;
+  Reparse r;
+  releaseSyntaxTree(ip->cx);
+  ip->garbage = 0;
+  memset(&none, 0, sizeof(none));
+  memset(&r, 0, sizeof(r));
+  r.old = &none;
+  reserveDecls(&r.fresh, 0);
+  r.fresh.starts[0] = 0;
+  parseEntries(ip->cx, &r, 0);
+  freeDecls(&ip->list);
+  ip->list = r.fresh;
+  ip->holes = r.holes;
+  linkDecls(&ip->list, 1, ip->list.count);
+  return ip->holes == 0;
+}
+
+int startIncremental(IncrementalParse *ip, CompileContext *cx)
+{
+  memset(ip, 0, sizeof(IncrementalParse));
+  ip->cx = cx;
+  scan(cx);
+  return fullParse(ip);
+}
+
+int editIncremental(IncrementalParse *ip, size_t start, size_t end, const char *text, size_t n)
+{
+  CompileContext *cx = ip->cx;
+  DeclList *l = &ip->list;
+  TokenEdit te;
+  Reparse r;
+  int a, b, i, m, tail, begin;
+  relexEdit(cx, start, end, text, n, &te);
+  ip->tree = NULL;
+  ip->recovered = FALSE;
+  cx->Error = FALSE;
+  cx->errorCount = cx->errorLine = 0;
+  if (ip->garbage > cx->TokenTable.count)
+    return fullParse(ip);
+
+  /* the nodes of a declaration take their lines from
+     the token after it too, so the entry the edit
+     starts in is parsed again even if the edit only
+     touches the token after it */
+  for (a = 0; a + 1 < l->count && l->starts[a + 1] < te.first; a++)
+    ;
+  begin = l->starts[a];
+  memset(&r, 0, sizeof(r));
+  r.old = l;
+  r.newEnd = te.newEnd;
+  r.shift = te.newEnd - te.oldEnd;
+  parseEntries(cx, &r, begin);
+  b = (r.resume >= 0) ? r.resume : l->count;
+  m = r.fresh.count;
+
+  /* entries a up to b give way to the m fresh ones;
+     those from b on move along with their tokens */
+  for (i = a; i < b; i++)
+    ip->holes -= (l->decls[i] == NULL);
+  ip->holes += r.holes;
+  ip->garbage += l->starts[b] - l->starts[a];
+  tail = l->count - b;
+  reserveDecls(l, a + m + tail);
+  memmove(l->decls + a + m, l->decls + b, tail * sizeof(TreeNode *));
+  memmove(l->starts + a + m, l->starts + b, (tail + 1) * sizeof(int));
+  memmove(l->lineShift + a + m, l->lineShift + b, tail * sizeof(int));
+  l->count = a + m + tail;
+  for (i = a + m; i <= l->count; i++)
+    l->starts[i] += r.shift;
+  if (te.lineDelta != 0)
+    for (i = a + m; i < l->count; i++)
+      l->lineShift[i] += te.lineDelta;
+  if (m > 0)
+  {
+    memcpy(l->decls + a, r.fresh.decls, m * sizeof(TreeNode *));
+    /* run to the end of the file, the fresh entries
+       also say where the last one ends */
+    memcpy(l->starts + a, r.fresh.starts, (tail > 0 ? m : m + 1) * sizeof(int));
+    memset(l->lineShift + a, 0, m * sizeof(int));
+  }
+  else if (tail == 0)
+    l->starts[a] = begin;
+  linkDecls(l, a, a + m);
+  freeDecls(&r.fresh);
+  return ip->holes == 0;
+}
+
+/* shiftLines adds lines to the line numbers of t and
+   of everything under it, but not of its siblings */
+static void shiftLines(TreeNode *t, int lines)
+{
+  int i;
+  TreeNode *c;
+  t->lineno += lines;
+  for (i = 0; i < MAXCHILDREN; i++)
+    for (c = t->child[i]; c != NULL; c = c->sibling)
+      shiftLines(c, lines);
+}
+
+TreeNode *incrementalTree(IncrementalParse *ip)
+{
+  DeclList *l = &ip->list;
+  int i;
+  if (ip->holes > 0)
+  {
+    if (!ip->recovered)
+    {
+      ip->tree = parse(ip->cx);
+      ip->garbage += ip->cx->TokenTable.count;
+      ip->recovered = TRUE;
+    }
+    return ip->tree;
+  }
+  for (i = 0; i < l->count; i++)
+    if (l->lineShift[i] != 0)
+    {
+      shiftLines(l->decls[i], l->lineShift[i]);
+      l->lineShift[i] = 0;
+    }
+  return l->count > 0 ? l->decls[0] : NULL;
+}
+
+void endIncremental(IncrementalParse *ip)
+{
+  freeDecls(&ip->list);
+  memset(ip, 0, sizeof(IncrementalParse));
+}
@@ -0,0 +1,71 @@
+/****************************************************/
+/* File: incr.h                                     */
+/* Incremental parsing: keeping the tokens and the  */
+/* syntax tree of a source up to date as it is      */
+/* edited                                           */
+/****************************************************/
+
+#ifndef _INCR_H_
+#define _INCR_H_
+#include "globals.h"
+
+/* a DeclList is a growing list of top-level
+ * declarations, each with the token it starts at
+ */
+typedef struct declList
+{
+  TreeNode **decls;  /* the declarations, NULL for a hole */
+  int *starts;       /* first token of each, and where the last ends */
+  int *lineShift;    /* lines still to be added to the nodes of each */
+  int count, capacity;
+} DeclList;
+
+/* an IncrementalParse keeps the parse of the source
+ * of cx as its top-level declarations. One that does
+ * not parse is kept as a hole running up to the next
+ * entry. An edit re-lexes only the tokens it touches
+ * (see relexEdit) and parses again only the entries
+ * those tokens are in
+ */
+typedef struct incrementalParse
+{
+  CompileContext *cx;
+  DeclList list;
+  int holes;
+  /* with holes, the tree is the one parse() recovers,
+     made by incrementalTree once for each edit */
+  TreeNode *tree;
+  int recovered;
+  /* tokens whose nodes were dropped since the last
+     full parse but are still held */
+  long garbage;
+} IncrementalParse;
+
+/* Function startIncremental scans and parses the
+ * source of cx into ip, which holds on to cx. It
+ * reports nothing and returns FALSE if the source
+ * has syntax errors
+ */
+int startIncremental(IncrementalParse *ip, CompileContext *cx);
+
+/* Function editIncremental replaces characters start
+ * up to end of the source with the n characters of
+ * text and brings the tokens and the tree up to date,
+ * returning FALSE if the source now has syntax errors
+ */
+int editIncremental(IncrementalParse *ip, size_t start, size_t end, const char *text, size_t n);
+
+/* Function incrementalTree returns the tree parse()
+ * would build from the source as it now is. If the
+ * source has syntax errors it is that tree: parse()
+ * is run on the whole source, reporting the errors
+ * to the listing
+ */
+TreeNode *incrementalTree(IncrementalParse *ip);
+
+/* Procedure endIncremental frees what ip holds, but
+ * not cx
+ */
+void endIncremental(IncrementalParse *ip);
+
+#endif
@@ -0,0 +1,176 @@
+/****************************************************/
+/* File: intern.c                                   */
+/* Identifier interning pool for the C- compiler    */
+/* Every distinct identifier is stored once and     */
+/* referred to by a dense 32-bit symbol id          */
+/****************************************************/
+
+#include "intern.h"
+
+/* INITSLOTS = initial size of the hash table,
+   must be a power of two */
+#define INITSLOTS 1024
+
+/* POOLCHUNK = size of the blocks the name
+   strings are carved from */
+#define POOLCHUNK 65536
+
+/* names are copied into chunks that are never
+   moved, so symbolName pointers stay valid */
+struct poolChunk
+{
+  struct poolChunk *next;
+  char *free;
+  char *end;
+};
+
+/* hashName is the FNV-1a hash of s[0..n) */
+static unsigned int hashName(const char *s, int n)
+{
+  unsigned int h = 2166136261u;
+  while (n-- > 0)
+    h = (h ^ (unsigned char)*s++) * 16777619u;
+  return h;
+}
+
+/* poolCopy stores a NUL-terminated copy of s[0..n) */
+static char *poolCopy(InternTable *it, const char *s, int n)
+{
+  char *t;
+  PoolChunk *pool = it->pool;
+  if (pool == NULL || pool->end - pool->free < n + 1)
+  {
+    size_t size = (n + 1 > POOLCHUNK) ? n + 1 : POOLCHUNK;
+    PoolChunk *c = (PoolChunk *)malloc(sizeof(PoolChunk) + size);
+    if (c == NULL)
+    {
+      fprintf(stderr, "Out of memory error interning names\n");
+      exit(1);
+    }
+    c->free = (char *)(c + 1);
+    c->end = c->free + size;
+    c->next = pool;
+    it->pool = pool = c;
+  }
+  t = pool->free;
+  memcpy(t, s, n);
+  t[n] = '\0';
+  pool->free += n + 1;
+  return t;
+}
+
+/* growSlots doubles the hash table and rehashes
+   every symbol into it */
+static void growSlots(InternTable *it)
+{
+  int count = it->slotCount ? 2 * it->slotCount : INITSLOTS;
+  int *slots;
+  int i;
+  free(it->slots);
+  it->slots = slots = (int *)malloc(count * sizeof(int));
+  if (slots == NULL)
+  {
+    fprintf(stderr, "Out of memory error interning names\n");
+    exit(1);
+  }
+  for (i = 0; i < count; i++)
+    slots[i] = NOSYMBOL;
+  it->slotCount = count;
+  for (i = 0; i < it->symCount; i++)
+  {
+    unsigned int h = it->hashes[i] & (count - 1);
+    while (slots[h] != NOSYMBOL)
+      h = (h + 1) & (count - 1);
+    slots[h] = i;
+  }
+}
+
+/* growSymbols doubles the per-symbol arrays */
+static void growSymbols(InternTable *it)
+{
+  int cap = it->symCapacity ? 2 * it->symCapacity : INITSLOTS / 2;
+  it->names = (const char **)realloc((void *)it->names, cap * sizeof(char *));
+  it->hashes = (unsigned int *)realloc(it->hashes, cap * sizeof(unsigned int));
+  it->lengths = (int *)realloc(it->lengths, cap * sizeof(int));
+  if (it->names == NULL || it->hashes == NULL || it->lengths == NULL)
+  {
+    fprintf(stderr, "Out of memory error interning names\n");
+    exit(1);
+  }
+  it->symCapacity = cap;
+}
+
+int internName(InternTable *it, const char *s, int n)
+{
+  unsigned int hash = hashName(s, n);
+  unsigned int h;
+  int id;
+  /* keep the table at most half full */
+  if (2 * (it->symCount + 1) > it->slotCount)
+    growSlots(it);
+  h = hash & (it->slotCount - 1);
+  while ((id = it->slots[h]) != NOSYMBOL)
+  {
+    if (it->hashes[id] == hash && it->lengths[id] == n && memcmp(it->names[id], s, n) == 0)
+      return id;
+    h = (h + 1) & (it->slotCount - 1);
+  }
+  if (it->symCount == it->symCapacity)
+    growSymbols(it);
+  id = it->symCount++;
+  it->names[id] = poolCopy(it, s, n);
+  it->hashes[id] = hash;
+  it->lengths[id] = n;
+  it->slots[h] = id;
+  return id;
+}
+
+const char *symbolName(const InternTable *it, int id)
+{
+  if (id < 0 || id >= it->symCount)
+    return NULL;
+  return it->names[id];
+}
+
+int symbolCount(const InternTable *it)
+{
+  return it->symCount;
+}
+
+void clearInternTable(InternTable *it)
+{
+  int i;
+  /* keep the chunk names were last copied into */
+  if (it->pool != NULL)
+  {
+    PoolChunk *keep = it->pool;
+    it->pool = keep->next;
+    while (it->pool != NULL)
+    {
+      PoolChunk *next = it->pool->next;
+      free(it->pool);
+      it->pool = next;
+    }
+    keep->next = NULL;
+    keep->free = (char *)(keep + 1);
+    it->pool = keep;
+  }
+  for (i = 0; i < it->slotCount; i++)
+    it->slots[i] = NOSYMBOL;
+  it->symCount = 0;
+}
+
+void destroyInternTable(InternTable *it)
+{
+  while (it->pool != NULL)
+  {
+    PoolChunk *next = it->pool->next;
+    free(it->pool);
+    it->pool = next;
+  }
+  free(it->slots);
+  free((void *)it->names);
+  free(it->hashes);
+  free(it->lengths);
+  memset(it, 0, sizeof(InternTable));
+}
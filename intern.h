@@ -0,0 +1,62 @@
+/****************************************************/
+/* File: intern.h                                   */
+/* Identifier interning pool for the C- compiler    */
+/****************************************************/
+
+#ifndef _INTERN_H_
+#define _INTERN_H_
+#include "globals.h"
+
+/* NOSYMBOL is the symbol id of "no name", e.g. the
+ * parameter list of a function declared (void)
+ */
+#define NOSYMBOL (-1)
+
+typedef struct poolChunk PoolChunk;
+
+/* an InternTable numbers the names of one
+ * CompileContext; a zeroed one is empty
+ */
+typedef struct internTable
+{
+  /* the hash table is open addressed; each slot
+     holds a symbol id or NOSYMBOL */
+  int *slots;
+  int slotCount;
+  /* per-symbol data, indexed by symbol id */
+  const char **names;
+  unsigned int *hashes;
+  int *lengths;
+  int symCount;
+  int symCapacity;
+  PoolChunk *pool; /* storage of the names */
+} InternTable;
+
+/* Function internName returns the symbol id of the
+ * n-character string s in it, adding it to the pool
+ * the first time it is seen. Ids are dense, start
+ * at 0 and stay valid until destroyInternTable
+ */
+int internName(InternTable *it, const char *s, int n);
+
+/* Function symbolName returns the NUL-terminated
+ * string of symbol id, or NULL for NOSYMBOL
+ */
+const char *symbolName(const InternTable *it, int id);
+
+/* Function symbolCount returns the number of
+ * distinct names interned so far
+ */
+int symbolCount(const InternTable *it);
+
+/* Procedure clearInternTable forgets every name of
+ * it but keeps its memory for the next ones
+ */
+void clearInternTable(InternTable *it);
+
+/* Procedure destroyInternTable frees every
+ * interned name, leaving it empty
+ */
+void destroyInternTable(InternTable *it);
+
+#endif
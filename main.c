@@ -23,9 +23,13 @@
 #define SAVE_RESULT_TO_FILE TRUE
 
 #include "util.h"
-#if NO_PARSE
 #include "scan.h"
-#else
+#include "batch.h"
+#include "server.h"
+#include "cache.h"
+#include "astfile.h"
+#include "writer.h"
+#if !NO_PARSE
 #include "parse.h"
 #if !NO_ANALYZE
 #include "analyze.h"
@@ -35,36 +39,272 @@
 #endif
 #endif
 
-/* allocate global variables */
-int lineno = 0;
-FILE *source;
-FILE *listing; // 保存token的文件.
-FILE *code;
+/* streamTokens = TRUE (--stream) lets the parser pull
+ * tokens on demand instead of scanning the whole
+ * file first
+ */
+static int streamTokens = FALSE;
+
+/* streamTree = TRUE (--stream-tree) writes out each
+ * top-level declaration as soon as it is parsed and
+ * then frees it, pulling tokens on demand as with
+ * --stream, so the memory used does not grow with
+ * the file (only with the names in it). The tree is
+ * written to a temporary file and copied to the
+ * listing once the parse is done, after the syntax
+ * errors, so the listing is the same
+ */
+static int streamTree = FALSE;
+
+/* pipeline = TRUE (--pipeline) runs the scanner on its
+ * own thread, feeding the parser through a ring
+ */
+static int pipeline = FALSE;
+
+/* scanThreads = N (--scan-threads N) scans the file
+ * in N chunks at once, 0 meaning one per CPU;
+ * verifyScan (--verify-scan) also scans it again
+ * sequentially and compares the two token streams
+ */
+static int scanThreads = 1;
+static int verifyScan = FALSE;
+static int scanMismatch = 0;
+
+/* flatTree = TRUE (--flat) builds the compact
+ * FlatTree instead of a tree of TreeNodes
+ */
+static int flatTree = FALSE;
+
+/* parseThreads = N (--parse-threads N) parses the
+ * top-level declarations on N threads, 0 meaning
+ * one per CPU
+ */
+static int parseThreads = 1;
+
+/* batch = TRUE (--batch) compiles every file, directory
+ * and @response file named on --jobs N threads (0, the
+ * default, meaning one per CPU); the listings go to
+ * --out-dir DIR, one file each, or all into result.txt
+ * in the order given
+ */
+static int batch = FALSE;
+static int jobs = 0;
+static char *outDir = NULL;
+
+/* server = TRUE (--server) answers parse requests
+ * read from stdin on stdout until stdin ends, see
+ * server.h
+ */
+static int server = FALSE;
+
+/* cacheDir = DIR (--cache DIR) looks the parse up in
+ * the cache kept in DIR, by a hash of the source, and
+ * adds it there when it is not found; the cache is
+ * kept to cacheLimit bytes (--cache-size MB)
+ */
+static char *cacheDir = NULL;
+static long long cacheLimit = 256LL << 20;
+
+/* checkOnly = TRUE (--check) only checks the syntax
+ * of each file named: nothing is written for a valid
+ * one, the errors in the others go to stderr, and the
+ * exit status is 1 if any file has one
+ */
+static int checkOnly = FALSE;
+
+/* treeFormat (--format text | json | sexp) is how the
+ * syntax tree is written in the listing, see writer.h
+ */
+static TreeFormat treeFormat = TextTree;
+
+/* astPath = FILE (--ast FILE) also writes the syntax
+ * tree to FILE in the binary format of astfile.h
+ */
+static char *astPath = NULL;
+
+/* StreamedTree is what printDecl writes with: the
+   tree goes to the temporary file tree */
+typedef struct streamedTree
+{
+  FILE *tree;
+  TreeWriter writer;
+} StreamedTree;
+
+/* printDecl is the parseEach callback of --stream-tree */
+static void printDecl(void *arg, TreeNode *decl)
+{
+  StreamedTree *st = (StreamedTree *)arg;
+  if (TraceParse)
+    writeTree(&st->writer, decl);
+}
+
+/* copyFile appends what is in from to to */
+static void copyFile(FILE *to, FILE *from)
+{
+  char buf[1 << 16];
+  size_t n;
+  rewind(from);
+  while ((n = fread(buf, 1, sizeof(buf), from)) > 0)
+    fwrite(buf, 1, n, to);
+}
 
-/* allocate and set tracing flags */
-int EchoSource = FALSE;
-int TraceScan = FALSE;
-int TraceParse = TRUE;
-int TraceAnalyze = FALSE;
-int TraceCode = FALSE;
+/* sourceName puts the file to read for name in pgm,
+ * adding ".tny" when name has no '.'; FALSE, with a
+ * message, if it does not fit in size characters
+ */
+static int sourceName(char *pgm, int size, const char *name)
+{
+  int n = snprintf(pgm, size, "%s%s", name, strchr(name, '.') == NULL ? ".tny" : "");
+  if (n < 0 || n >= size)
+  {
+    fprintf(stderr, "File name %s is too long\n", name);
+    return FALSE;
+  }
+  return TRUE;
+}
 
-int Error = FALSE;
+/* checkFile checks the syntax of file name, without
+ * building a tree or interning a name; FALSE if it
+ * has errors or can not be read
+ */
+static int checkFile(const char *name)
+{
+  char pgm[4096];
+  CompileContext *cx;
+  FILE *source;
+  int errors;
+  if (!sourceName(pgm, sizeof(pgm), name))
+    return FALSE;
+  source = fopen(pgm, "r");
+  if (source == NULL)
+  {
+    fprintf(stderr, "File %s not found\n", pgm);
+    return FALSE;
+  }
+  cx = newCompileContext(source, stderr);
+  if (cx == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  skipNames(cx);
+  errors = checkSyntax(cx);
+  if (errors > 0)
+    fprintf(stderr, "\n%s: %d syntax error%s, the first at line %d\n",
+            pgm, errors, errors == 1 ? "" : "s", cx->errorLine);
+  freeCompileContext(cx);
+  fclose(source);
+  return errors == 0;
+}
 
 int main(int argc, char *argv[]) {
-  TreeNode *syntaxTree;
+  TreeNode *syntaxTree = NULL;
+  FlatTree flat;
+  CompileContext *cx;
+  long listingStart;
+  int cached = FALSE;
+  int astFailed = FALSE;
+  FILE *source;
+  FILE *listing; // 保存token的文件.
 
   // 读取输入的文件名, 并拷贝到pgm字符数组里
-  char pgm[120]; /* source code file name */
-  if (argc != 2) // 参数不正确
+  char pgm[4096]; /* source code file name */
+  char *filename;
+  char *inputs[argc]; /* the names given, in order */
+  int inputCount = 0;
+  int i;
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--stream") == 0)
+      streamTokens = TRUE;
+    else if (strcmp(argv[i], "--stream-tree") == 0)
+      streamTree = TRUE;
+    else if (strcmp(argv[i], "--pipeline") == 0)
+      pipeline = TRUE;
+    else if (strcmp(argv[i], "--scan-threads") == 0 && i + 1 < argc)
+      scanThreads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--verify-scan") == 0)
+      verifyScan = TRUE;
+    else if (strcmp(argv[i], "--flat") == 0)
+      flatTree = TRUE;
+    else if (strcmp(argv[i], "--parse-threads") == 0 && i + 1 < argc)
+      parseThreads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--max-errors") == 0 && i + 1 < argc)
+      MaxErrors = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--batch") == 0)
+      batch = TRUE;
+    else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+      jobs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc)
+      outDir = argv[++i];
+    else if (strcmp(argv[i], "--server") == 0)
+      server = TRUE;
+    else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+      cacheDir = argv[++i];
+    else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc)
+      cacheLimit = atoll(argv[++i]) << 20;
+    else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc && treeFormatOf(argv[i + 1], &treeFormat))
+      i++;
+    else if (strcmp(argv[i], "--check") == 0)
+      checkOnly = TRUE;
+    else if (strcmp(argv[i], "--ast") == 0 && i + 1 < argc)
+      astPath = argv[++i];
+    else if (argv[i][0] != '-')
+      inputs[inputCount++] = argv[i];
+    else
+      break;
+  }
+  if (server && i == argc && inputCount == 0 && !batch)
+    return serveRequests(stdin, stdout);
+  if (checkOnly && !server && !batch && i == argc && inputCount > 0)
   {
-    fprintf(stderr, "usage: %s <filename>\n", argv[0]);
+    int failed = 0;
+    for (i = 0; i < inputCount; i++)
+      failed += !checkFile(inputs[i]);
+    return failed ? 1 : 0;
+  }
+  if (checkOnly || server || i < argc || inputCount == 0 || (!batch && inputCount > 1) || // 参数不正确
+      (batch && (streamTokens || pipeline || scanThreads != 1 || verifyScan || parseThreads != 1 || cacheDir)) ||
+      (cacheDir && (streamTokens || pipeline || verifyScan)) ||
+      /* ways to scan, or to parse, that exclude each other */
+      (streamTokens + pipeline + (scanThreads != 1 || verifyScan) > 1) || (flatTree && parseThreads != 1) ||
+      (streamTree && (batch || scanThreads != 1 || flatTree || parseThreads != 1 || cacheDir || astPath)))
+  {
+    fprintf(stderr, "usage: %s [--stream | --pipeline | --scan-threads N [--verify-scan]] [--flat | --parse-threads N] [--max-errors N]\n"
+                    "           [--cache DIR [--cache-size MB]] [--ast FILE] [--format text | json | sexp] <filename>\n"
+                    "       %s --stream-tree [--pipeline] [--max-errors N] [--format text | json | sexp] <filename>\n"
+                    "       %s --batch [--jobs N] [--out-dir DIR] [--flat] [--max-errors N] [--format text | json | sexp]\n"
+                    "           <file | dir | @list>...\n"
+                    "       %s --server [--max-errors N]\n"
+                    "       %s --check [--max-errors N] <filename>...\n",
+            argv[0], argv[0], argv[0], argv[0], argv[0]);
     exit(1);
   }
-  strcpy(pgm, argv[1]);
+  if (batch)
+  {
+    BatchList files = {0};
+    int failed;
+    for (i = 0; i < inputCount; i++)
+      if (!addBatchInput(&files, inputs[i]))
+        exit(1);
+    listing = NULL;
+    if (outDir == NULL && (listing = fopen("result.txt", "w+")) == NULL)
+    {
+      fprintf(stderr, "Unable to write result.txt\n");
+      exit(1);
+    }
+    failed = compileBatch(&files, jobs, flatTree, treeFormat, outDir, listing);
+    fprintf(stderr, "%d files compiled, %d failed\n", files.count, failed);
+    if (listing != NULL)
+      fclose(listing);
+    freeBatchList(&files);
+    return failed ? 1 : 0;
+  }
+  filename = inputs[0];
 
   // 打开输入文件.
-  if (strchr(pgm, '.') == NULL)
-    strcat(pgm, ".tny");
+  if (!sourceName(pgm, sizeof(pgm), filename))
+    exit(1);
   source = fopen(pgm, "r");
   if (source == NULL) {
     fprintf(stderr, "File %s not found\n", pgm);
@@ -80,17 +320,81 @@ int main(int argc, char *argv[]) {
   listing = stdout; /* send listing to screen */
   fprintf(listing, "\nC-minus COMPILATION: %s\n", pgm);
 #endif
+  cx = newCompileContext(source, listing);
+  if (cx == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
 
-// 如果没有语法分析, 仅做词法扫描
-  scan();
-  syntaxTree = parse();
-  if (TraceParse) {
+  initFlatTree(&flat);
+  listingStart = ftell(listing);
+  if (cacheDir != NULL && loadCachedParse(cacheDir, cx, &flat))
+    cached = TRUE;
+  else
+  {
+    /* unless streaming, scan the whole file before parsing;
+     * otherwise parse() pulls tokens as it needs them */
+    if (pipeline)
+      startScanThread(cx);
+    else if (verifyScan)
+    {
+      scanMismatch = verifyParallelScan(cx, scanThreads);
+      if (scanMismatch == 0)
+        fprintf(stderr, "parallel scan matches: %lld tokens\n", cx->TokenTable.count);
+    }
+    else if (scanThreads != 1)
+      scanParallel(cx, scanThreads);
+    else if (!streamTokens && !streamTree)
+      scan(cx);
+    if (streamTree)
+    {
+      StreamedTree st;
+      memset(&st, 0, sizeof(st));
+      if (TraceParse)
+      {
+        if ((st.tree = tmpfile()) == NULL)
+        {
+          fprintf(stderr, "Unable to open a temporary file for the tree\n");
+          exit(1);
+        }
+        startTreeWriter(&st.writer, st.tree, treeFormat, cx->symbols);
+      }
+      parseEach(cx, printDecl, &st);
+      if (TraceParse)
+      {
+        endTreeWriter(&st.writer);
+        fprintf(listing, "\nSyntax tree:\n");
+        copyFile(listing, st.tree);
+        fclose(st.tree);
+      }
+    }
+    else if (flatTree)
+      parseFlat(cx, &flat);
+    else if (parseThreads != 1)
+      syntaxTree = parseParallel(cx, parseThreads);
+    else
+      syntaxTree = parse(cx);
+    stopScanThread(cx);
+    if (!flatTree && (cacheDir != NULL || astPath != NULL))
+      appendFlatTree(&flat, syntaxTree);
+    if (cacheDir != NULL)
+      storeCachedParse(cacheDir, cacheLimit, cx, &flat, listingStart);
+  }
+  if (astPath != NULL && !writeAstFile(astPath, &flat, cx->symbols))
+    astFailed = TRUE;
+  if (TraceParse && !streamTree) {
+    TreeWriter w;
     fprintf(listing, "\nSyntax tree:\n");
-    printTree(syntaxTree);
+    startTreeWriter(&w, listing, treeFormat, cx->symbols);
+    if (flatTree || cached)
+      writeFlatTree(&w, &flat);
+    else
+      writeTree(&w, syntaxTree);
+    endTreeWriter(&w);
   }
-  destroyTokenTable();
-  destroySyntaxTree(syntaxTree);
+  destroyFlatTree(&flat);
+  freeCompileContext(cx);
   fclose(source);
   fclose(listing);
-  return 0;
+  return (scanMismatch || astFailed) ? 1 : 0;
 }
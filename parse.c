@@ -9,567 +9,816 @@
 #include "globals.h"
 #include "scan.h"
 #include "util.h"
-#include <stdarg.h>
-
-static TokenNode *token; /* holds current token */
-
-// todo: 更改为c-minus的递归调用
-static TreeNode *program(void);
-static TreeNode *Declaration_List(void);
-static TreeNode *Declaration(void);
-static TreeNode *localDeclarations(void);
-static TreeNode *var_declaration(void);
-static TreeNode *fun_declaration(void);
-static TreeNode *type_specifier(void);
-static TreeNode *params(void);
-static TreeNode *param(void);
-static TreeNode *compound_stmt(void);
-static TreeNode *statement_list(void);
-static TreeNode *statement(void);
-static TreeNode *selection_stmt(void);
-static TreeNode *iteration_stmt(void);
-static TreeNode *return_stmt(void);
-static TreeNode *additive_exp(void);
-static TreeNode *term(void);
-static TreeNode *factor(void);
-static TreeNode *args(void);
-static TreeNode *expression_stmt(void);
-static TreeNode *expression(void);
-static TreeNode *simple_exp(void);
-static void match(TokenType);
-static void unmatch();
-static void syntaxError(char *);
-static void assignName(char *destination, char *source);
-static TypeSpecifier tokenTypetoTypeSpecifier(TokenType);
-static void promissType(int num, ...);
-
-void promissType(int num, ...)
+#include "arena.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/* llTable, llRhs and the NT_ and ACT_ symbols are
+   generated from grammar.ll */
+#include "lltab.h"
+
+/* MaxErrors = N (--max-errors N) stops the parse after
+   N syntax errors, 0 meaning never */
+int MaxErrors = 20;
+
+/* RECOVERTOKENS = tokens to match to leave recovery */
+#define RECOVERTOKENS 3
+
+/* SYNCTOKENS are the tokens that start or end a
+   statement or declaration; skipping after an error
+   stops at them */
+#define SYNCTOKENS (TOKBIT(SEMI) | TOKBIT(LBRACE) | TOKBIT(RBRACE) | TOKBIT(IF) | \
+                    TOKBIT(WHILE) | TOKBIT(RETURN) | TOKBIT(INT) | TOKBIT(VOID))
+
+/* ParseValue is an entry of the value stack the
+ * actions of grammar.ll build the tree on: a node, a
+ * list of nodes (node is its first, tail its last)
+ * or, in val, a type or a symbol id
+ */
+typedef struct parseValue
 {
-  va_list varlist;
-  va_start(varlist, num);
-  int i;
-  for (i = 0; i < num; i++)
-  {
-    if (token->type == va_arg(varlist, TokenType))
-    {
-      va_end(varlist);
-      return;
-    }
-  }
+  TreeNode *node;
+  TreeNode *tail;
+  int val;
+} ParseValue;
 
-  va_end(varlist);
-  char *errMsg = (char *)malloc(sizeof(char) * 100);
-  sscanf(errMsg, "unknonw token '%s'", tokenString);
-  syntaxError(errMsg);
+/* ParseState is everything one parse changes, so
+ * several can run at once on different tokens
+ */
+typedef struct parseState
+{
+  CompileContext *cx;
+  long long token; /* index of current token in TokenTable */
+  /* the symbol stack holds what is still to be
+     parsed, the value stack what has been built.
+     Both grow on demand, so nesting is not limited
+     by the C stack */
+  short *symbols;
+  int symbolTop, symbolCapacity;
+  ParseValue *values;
+  int valueTop, valueCapacity;
+  /* operators holds the operators of the expressions
+     being parsed that wait for their right operand;
+     a NULL starts the operators of each expression */
+  TreeNode **operators;
+  int operatorTop, operatorCapacity;
+  /* errorCount counts the errors reported; recovering
+     is the number of tokens still to match after an
+     error before another one is reported, so one
+     mistake does not show up as a cascade of errors;
+     gaveUp is set once MaxErrors is reached */
+  int errorCount;
+  int recovering;
+  int gaveUp;
+  /* missing = TRUE when the terminal last popped was
+     not there, so the actions after it have no token
+     of theirs to read */
+  int missing;
+  /* quiet = TRUE reports nothing and gives up at the
+     first error, which only sets error */
+  int quiet;
+  int error;
+  /* recognize = TRUE runs no actions, so no tree is
+     built and the value stack stays empty */
+  int recognize;
+  /* parsed, unless NULL, is handed each top-level
+     declaration in place of its being appended to
+     the list of them */
+  void (*parsed)(void *arg, TreeNode *decl);
+  void *parsedArg;
+  char lexeme[MAXTOKENLEN + 1]; /* lexeme of the token reported */
+} ParseState;
+
+/* INITSTACK = initial capacity of each stack */
+#define INITSTACK 256
+
+/* syntaxError counts an error of the current token
+   and reports it unless there is no listing */
+static void syntaxError(ParseState *ps, char *message)
+{
+  CompileContext *cx = ps->cx;
+  if (cx->errorCount++ == 0)
+    cx->errorLine = TOKENLINE(cx, ps->token);
+  cx->Error = TRUE;
+  if (cx->listing == NULL)
+    return;
+  fprintf(cx->listing, "\n>>> ");
+  fprintf(cx->listing, "Syntax error at line %d: %s", TOKENLINE(cx, ps->token), message);
 }
 
-TypeSpecifier tokenTypetoTypeSpecifier(TokenType tt)
+/* unexpectedToken reports the current token unless
+ * an earlier error is still being recovered from, and
+ * gives up once MaxErrors have been reported
+ */
+static void unexpectedToken(ParseState *ps)
 {
-  if (tt == INT)
+  ps->error = TRUE;
+  if (ps->quiet)
   {
-    return Integer;
+    ps->gaveUp = TRUE;
+    return;
   }
-  else if (tt == VOID)
+  if (ps->recovering > 0)
   {
-    return Void;
+    ps->recovering = RECOVERTOKENS;
+    return;
   }
-  else
+  ps->recovering = RECOVERTOKENS;
+  syntaxError(ps, "unexpected token -> ");
+  if (ps->cx->listing != NULL)
   {
-    perror("unable to convert this TokenType to TypeSpecifier!");
+    copyTokenString(ps->cx, ps->token, ps->lexeme, sizeof(ps->lexeme));
+    printToken(ps->cx, TOKENTYPE(ps->cx, ps->token), ps->lexeme);
+    fprintf(ps->cx->listing, "      ");
+  }
+  if (++ps->errorCount == MaxErrors)
+  {
+    if (ps->cx->listing != NULL)
+      fprintf(ps->cx->listing, "\n>>> Too many syntax errors, giving up\n");
+    ps->gaveUp = TRUE;
   }
 }
 
-TreeNode *program()
+/* advance moves to the next token, pulling it from
+ * the scanner if it has not been scanned yet
+ */
+static void advance(ParseState *ps)
 {
-  TreeNode *t = Declaration_List();
-  return t;
+  ps->token++;
+  if (ps->token == ps->cx->TokenTable.count)
+    getNextToken(ps->cx);
 }
 
-TreeNode *Declaration_List()
+/* skipStray reports the current token, a character
+   the scanner made an ERROR of, and moves past it.
+   The symbol just popped goes back on the stack to
+   be tried on the next token */
+static void skipStray(ParseState *ps)
 {
-  TreeNode *t = Declaration();
-  TreeNode *p = t;
-  while (token->type != ENDFILE)
-  {
-    p->sibling = Declaration();
-    if (p->sibling == NULL)
-    {
-      break;
-    }
-    p = p->sibling;
-  }
-  return t;
+  unexpectedToken(ps);
+  if (ps->gaveUp)
+    return;
+  advance(ps);
+  ps->symbolTop++;
 }
 
-TreeNode *Declaration()
+/* match moves past the expected token. A missing one
+   is reported and taken as if it had been there */
+static void match(ParseState *ps, TokenType expected)
 {
-  TreeNode *tr = NULL;
-  promissType(2, INT, VOID);
-  match(token->type);
-  match(ID);
-  if (token->type == LPAREN)
-  {
-    unmatch();
-    unmatch();
-    tr = fun_declaration();
+  ps->missing = FALSE;
+  if (TOKENTYPE(ps->cx, ps->token) == expected && expected != ENDFILE){
+    advance(ps);
+    if (ps->recovering > 0)
+      ps->recovering--;
+  } else if (TOKENTYPE(ps->cx, ps->token) == ERROR) {
+    skipStray(ps);
   }
   else
   {
-    unmatch();
-    unmatch();
-    tr = var_declaration();
+    ps->missing = TRUE;
+    unexpectedToken(ps);
   }
-  return tr;
 }
 
-TreeNode *var_declaration()
+/* growStacks doubles the symbol stack until it has
+   room for n more symbols, and the value stack if it
+   is full */
+static void growStacks(ParseState *ps, int n)
 {
-  TreeNode *tr = NULL;
-  promissType(2, INT, VOID);
-
-  TypeSpecifier ts = tokenTypetoTypeSpecifier(token->type);
-  match(token->type);
-  char *idName = token->tokenString;
-  match(ID);
-
-  if (token->type == LBRACKET)
+  if (ps->symbolTop + n > ps->symbolCapacity)
   {
-    match(LBRACKET);
-    char *len_str = token->tokenString;
-    match(NUM);
-    int len = atoi(len_str);
-    tr = newDclrNode(VarArrK, ts, idName, len, NULL, NULL, token->lineno);
-    match(RBRACKET);
+    while (ps->symbolTop + n > ps->symbolCapacity)
+      ps->symbolCapacity = ps->symbolCapacity ? 2 * ps->symbolCapacity : INITSTACK;
+    ps->symbols = (short *)realloc(ps->symbols, ps->symbolCapacity * sizeof(short));
   }
-  else
+  if (ps->valueTop == ps->valueCapacity)
   {
-    tr = newDclrNode(VarK, ts, idName, 0, NULL, NULL, token->lineno);
+    ps->valueCapacity = ps->valueCapacity ? 2 * ps->valueCapacity : INITSTACK;
+    ps->values = (ParseValue *)realloc(ps->values, ps->valueCapacity * sizeof(ParseValue));
+  }
+  if (ps->symbols == NULL || ps->values == NULL)
+  {
+    fprintf(stderr, "Out of memory error at line %d\n", TOKENLINE(ps->cx, ps->token));
+    exit(1);
   }
-  match(SEMI);
-
-  return tr;
 }
 
-TreeNode *fun_declaration()
+static void pushValue(ParseState *ps, TreeNode *node, int val)
 {
-  TreeNode *tr;
-  promissType(2, INT, VOID);
-  TypeSpecifier ts = tokenTypetoTypeSpecifier(token->type);
-  match(token->type);
-  char *idName = token->tokenString;
-  match(ID);
-  match(LPAREN);
-  TreeNode *_params = params();
-  match(RPAREN);
-  TreeNode *_compound_stmt = compound_stmt();
-  tr = newDclrNode(FunK, ts, idName, 0, _params, _compound_stmt, token->lineno);
-  return tr;
+  if (ps->valueTop == ps->valueCapacity)
+    growStacks(ps, 0);
+  ps->values[ps->valueTop].node = ps->values[ps->valueTop].tail = node;
+  ps->values[ps->valueTop].val = val;
+  ps->valueTop++;
 }
 
-TreeNode *params()
+/* pushOperator pushes t on the operator stack */
+static void pushOperator(ParseState *ps, TreeNode *t)
 {
-  TreeNode *tr = NULL;
-  promissType(2, INT, VOID);
-  TypeSpecifier idType;
-  idType = tokenTypetoTypeSpecifier(token->type);
-
-  match(token->type); // match then type specifier
-  if (token->type != ID)
+  if (ps->operatorTop == ps->operatorCapacity)
   {
-    // 无参数
-    unmatch();
-    match(VOID);
-    tr = newDclrNode(VarK, Void, NULL, 0, NULL, NULL, token->lineno);
-  }
-  else
-  {
-    // 有参数
-    unmatch(); // unmatch then type specifier
-    TreeNode *p = param();
-    tr = p;
-    while (token->type == COMMA)
+    ps->operatorCapacity = ps->operatorCapacity ? 2 * ps->operatorCapacity : INITSTACK;
+    ps->operators = (TreeNode **)realloc(ps->operators, ps->operatorCapacity * sizeof(TreeNode *));
+    if (ps->operators == NULL)
     {
-      match(COMMA);
-      TreeNode *q = param();
-      if (q != NULL)
-      {
-        p->sibling = q;
-        p = q;
-      }
+      fprintf(stderr, "Out of memory error at line %d\n", TOKENLINE(ps->cx, ps->token));
+      exit(1);
     }
   }
-  return tr;
+  ps->operators[ps->operatorTop++] = t;
 }
 
-TreeNode *param()
+static ParseValue popValue(ParseState *ps)
 {
-  TreeNode *tr = NULL;
-  promissType(2, INT, VOID);
-  TypeSpecifier ts = tokenTypetoTypeSpecifier(token->type);
-  match(token->type);
-  char *idName = token->tokenString;
-  match(ID);
-  if (token->type == LBRACKET)
-  {
-    match(LBRACKET);
-    tr = newDclrNode(VarArrK, ts, idName, 0, NULL, NULL, token->lineno);
-    match(RBRACKET);
-  }
-  else
-  {
-    tr = newDclrNode(VarK, ts, idName, 0, NULL, NULL, token->lineno);
-  }
-  return tr;
+  static const ParseValue none = {NULL, NULL, 0};
+  return ps->valueTop > 0 ? ps->values[--ps->valueTop] : none;
 }
 
-TreeNode *compound_stmt()
+/* topNode is the node on top of the value stack */
+#define topNode(ps) ((ps)->valueTop > 0 ? (ps)->values[(ps)->valueTop - 1].node : NULL)
+
+/* the token just matched, which the actions read */
+#define previous(ps) ((ps)->token > 0 ? (ps)->token - 1 : 0)
+
+/* setChild pops a node into child[i] of the node
+   below it */
+static void setChild(ParseState *ps, int i)
 {
-  TreeNode *cs = newStmtNode(CompoundK, token->lineno);
-  match(LBRACE);
-  if (token->type == INT || token->type == VOID)
-  {
-    cs->child[0] = localDeclarations();
-  }
-  cs->child[1] = statement_list();
-  match(RBRACE);
-  return cs;
+  ParseValue v = popValue(ps);
+  if (topNode(ps) != NULL)
+    topNode(ps)->child[i] = v.node;
 }
 
-TreeNode *localDeclarations()
+/* bindingPower gives how tightly each binary
+ * operator holds its operands; 0 for tokens that
+ * are not binary operators
+ */
+static const unsigned char bindingPower[NTOKENTYPES] = {
+    [LT] = 1, [GT] = 1, [LE] = 1, [GE] = 1, [EQ] = 1, [NE] = 1,
+    [PLUS] = 2, [SUB] = 2,
+    [MUL] = 3, [DIV] = 3};
+
+/* climb takes operand x as the right operand of the
+ * operators on top of the operator stack that bind
+ * at least minPower, from the top down, so each
+ * operator gets as its right operand everything
+ * binding tighter than it. The result is returned.
+ * A minPower of 0 takes all operators of the
+ * expression, and pops the NULL that starts them
+ */
+static TreeNode *climb(ParseState *ps, TreeNode *x, int minPower)
 {
-  TreeNode *tr;
-  promissType(2, INT, VOID);
-  TreeNode *p = var_declaration();
-  tr = p;
-  while (token->type == INT || token->type == VOID)
+  TreeNode *o;
+  while (ps->operatorTop > 0)
   {
-    TreeNode *q = var_declaration();
-    if (q != NULL)
+    o = ps->operators[ps->operatorTop - 1];
+    if (o == NULL)
     {
-      p->sibling = q;
-      p = q;
+      if (minPower == 0)
+        ps->operatorTop--;
+      break;
     }
+    if (bindingPower[o->attr.op] < minPower)
+      break;
+    o->child[1] = x;
+    x = o;
+    ps->operatorTop--;
   }
-  return tr;
-}
-
-TreeNode *statement_list()
-{
-  TreeNode *tr = NULL;
-  TreeNode *p = NULL;
-  if (token->type == LBRACE || token->type == IF || token->type == WHILE || token->type == RETURN || token->type == ID || token->type == LPAREN || token->type == NUM)
-  {
-    tr = statement();
-    p = tr;
-  }
-  while (token->type == LBRACE || token->type == IF || token->type == WHILE || token->type == RETURN || token->type == ID || token->type == LPAREN || token->type == NUM)
-  {
-    TreeNode *q = statement();
-    p->sibling = q;
-    p = q;
-  }
-  return tr;
+  return x;
 }
 
-TreeNode *statement()
+/* runAction runs action a of grammar.ll. Nodes are
+ * given the line numbers the recursive descent parser
+ * gave them: mostly that of the token after the one
+ * just matched
+ */
+static void runAction(ParseState *ps, int a)
 {
-  TreeNode *tr = NULL;
-  TokenType tt = token->type;
-  switch (tt)
+  ParseValue v, w, x;
+  TreeNode *t;
+  switch (a)
   {
-  case LBRACE:
-    tr = compound_stmt();
+  case ACT_list:
+    pushValue(ps, NULL, 0);
     break;
-  case IF:
-    tr = selection_stmt();
+  case ACT_append:
+    v = popValue(ps);
+    if (ps->parsed != NULL && ps->valueTop == 1)
+    { /* a top-level declaration: the list is all
+         that is below it */
+      if (v.node != NULL)
+        ps->parsed(ps->parsedArg, v.node);
+      /* the block is kept for the next declaration */
+      arenaReset(ps->cx->nodes);
+    }
+    else if (v.node != NULL && ps->valueTop > 0)
+    {
+      ParseValue *list = &ps->values[ps->valueTop - 1];
+      if (list->node == NULL)
+        list->node = v.node;
+      else
+        list->tail->sibling = v.node;
+      for (list->tail = v.node; list->tail->sibling != NULL; list->tail = list->tail->sibling)
+        ;
+    }
     break;
-  case WHILE:
-    tr = iteration_stmt();
+  case ACT_int:
+    pushValue(ps, NULL, Integer);
     break;
-  case RETURN:
-    tr = return_stmt();
+  case ACT_void:
+    pushValue(ps, NULL, Void);
+    break;
+  case ACT_name:
+    /* a missing identifier has no name */
+    pushValue(ps, NULL, ps->missing ? NOSYMBOL : TOKENATTR(ps->cx, previous(ps)));
+    break;
+  case ACT_var:
+    v = popValue(ps);
+    w = popValue(ps);
+    pushValue(ps, newDclrNode(ps->cx, VarK, w.val, v.val, 0, NULL, NULL, TOKENLINE(ps->cx, ps->token)), 0);
+    break;
+  case ACT_vararr:
+  case ACT_parr:
+    v = popValue(ps);
+    w = popValue(ps);
+    pushValue(ps, newDclrNode(ps->cx, VarArrK, w.val, v.val, a == ACT_vararr && !ps->missing ? TOKENATTR(ps->cx, previous(ps)) : 0,
+                          NULL, NULL, TOKENLINE(ps->cx, ps->token)),
+              0);
+    break;
+  case ACT_noparam:
+    popValue(ps);
+    pushValue(ps, newDclrNode(ps->cx, VarK, Void, NOSYMBOL, 0, NULL, NULL, TOKENLINE(ps->cx, ps->token)), 0);
+    break;
+  case ACT_fun:
+    x = popValue(ps); /* body */
+    w = popValue(ps); /* params */
+    v = popValue(ps); /* name */
+    t = newDclrNode(ps->cx, FunK, popValue(ps).val, v.val, 0, w.node, x.node, TOKENLINE(ps->cx, ps->token));
+    pushValue(ps, t, 0);
+    break;
+  case ACT_compound:
+    pushValue(ps, newStmtNode(ps->cx, CompoundK, TOKENLINE(ps->cx, ps->token)), 0);
+    break;
+  case ACT_if:
+    pushValue(ps, newStmtNode(ps->cx, SelectionK, TOKENLINE(ps->cx, ps->token)), 0);
+    break;
+  case ACT_while:
+    pushValue(ps, newStmtNode(ps->cx, IterationK, TOKENLINE(ps->cx, ps->token)), 0);
+    break;
+  case ACT_return:
+    pushValue(ps, newStmtNode(ps->cx, ReturnK, TOKENLINE(ps->cx, ps->token)), 0);
+    break;
+  case ACT_kid0:
+  case ACT_kid1:
+  case ACT_kid2:
+    setChild(ps, a - ACT_kid0);
+    break;
+  case ACT_id:
+    t = newExpNode(ps->cx, IdK, Integer, TOKENLINE(ps->cx, ps->token));
+    t->attr.name = TOKENATTR(ps->cx, previous(ps));
+    pushValue(ps, t, 0);
+    break;
+  case ACT_sub:
+  case ACT_call:
+    if ((t = topNode(ps)) != NULL)
+    {
+      t->kind.exp = (a == ACT_sub) ? IdArrK : CallK;
+      t->lineno = TOKENLINE(ps->cx, ps->token);
+    }
+    break;
+  case ACT_const:
+    t = newExpNode(ps->cx, ConstK, Integer, TOKENLINE(ps->cx, previous(ps)));
+    t->attr.val = TOKENATTR(ps->cx, previous(ps));
+    pushValue(ps, t, 0);
+    break;
+  case ACT_chain:
+    pushOperator(ps, NULL);
+    break;
+  case ACT_op:
+    /* operators are left associative: those before
+       binding as tightly are done with */
+    t = newExpNode(ps->cx, OpK, Integer, TOKENLINE(ps->cx, previous(ps)));
+    t->attr.op = TOKENTYPE(ps->cx, previous(ps));
+    t->child[0] = climb(ps, popValue(ps).node, bindingPower[t->attr.op]);
+    pushOperator(ps, t);
+    break;
+  case ACT_fold:
+    pushValue(ps, climb(ps, popValue(ps).node, 0), 0);
+    break;
+  case ACT_assign:
+    v = popValue(ps);
+    t = newStmtNode(ps->cx, ASSIGNK, TOKENLINE(ps->cx, ps->token));
+    t->child[0] = v.node;
+    pushValue(ps, t, 0);
     break;
-  default:
-    tr = expression_stmt();
-  }
-  return tr;
-}
-
-TreeNode *selection_stmt()
-{
-  TreeNode *tr = newStmtNode(SelectionK, token->lineno);
-  match(IF);
-  match(LPAREN);
-  tr->child[0] = expression();
-  match(RPAREN);
-  tr->child[1] = statement();
-  if (token->type == ELSE)
-  {
-    match(ELSE);
-    tr->child[2] = statement();
   }
-  return tr;
 }
 
-TreeNode *iteration_stmt()
+/* pushPredicted pushes entry e of llPredicted, for
+   the recognizer of checkSyntax */
+static void pushPredicted(ParseState *ps, int e)
 {
-  TreeNode *tr = newStmtNode(IterationK, token->lineno);
-  match(WHILE);
-  match(LPAREN);
-  tr->child[0] = expression();
-  match(RPAREN);
-  tr->child[1] = statement();
-  return tr;
+  int n = llPredictedStart[e + 1] - llPredictedStart[e];
+  if (ps->symbolTop + n > ps->symbolCapacity)
+    growStacks(ps, n);
+  memcpy(ps->symbols + ps->symbolTop, llPredicted + llPredictedStart[e], n * sizeof(short));
+  ps->symbolTop += n;
 }
 
-TreeNode *return_stmt()
-{
-  TreeNode *tr = newStmtNode(ReturnK, token->lineno);
-  match(RETURN);
-  tr->child[0] = expression();
-  match(SEMI);
-  return tr;
-}
-
-TreeNode *expression_stmt()
-{
-  TreeNode *tr = expression();
-  match(SEMI);
-  return tr;
-}
-
-TreeNode *expression()
+/* expand expands nonterminal n, just popped, on the
+ * current token. On a token the table has no
+ * production for, n skips ahead to one it can start
+ * with, be followed by or, unless it is the outermost,
+ * a SYNCTOKENS. If it still cannot start there it is
+ * given up, with empty values for those its actions
+ * would have left. Each token is skipped at most once,
+ * so recovery stays linear in the input
+ */
+static void expand(ParseState *ps, int n)
 {
-  TreeNode *tr = NULL;
-  if (token->type == ID)
+  int p = llTable[n][TOKENTYPE(ps->cx, ps->token)];
+  if (p == 0 && TOKENTYPE(ps->cx, ps->token) == ERROR)
+    skipStray(ps);
+  else if (p == 0)
   {
-    char *idName = token->tokenString;
-    TokenNode *backpoint = token;
-    match(ID);
-    if (token->type == ASSIGN) // ID赋值语句
-    {
-      tr = newStmtNode(ASSIGNK, token->lineno);
-      tr->child[0] = newExpNode(IdK, Integer, token->lineno);
-      tr->child[0]->attr.name = idName;
-      match(ASSIGN);
-      tr->child[1] = expression();
-    }
-    else
+    unsigned long long stop = llFirst[n] | llFollow[n] | TOKBIT(ENDFILE);
+    if (ps->symbolTop > 0)
+      stop |= SYNCTOKENS;
+    /* where a statement may start, a ';' only ends
+       the bad one: skip past it to the next */
+    if ((llFirst[n] & llFirst[NT_statement]) == llFirst[NT_statement])
+      stop &= ~TOKBIT(SEMI);
+    unexpectedToken(ps);
+    while (!(stop & TOKBIT(TOKENTYPE(ps->cx, ps->token))) && !ps->gaveUp)
+      advance(ps);
+    if (llTable[n][TOKENTYPE(ps->cx, ps->token)] != 0)
+      ps->symbolTop++;
+    else if (!ps->recognize)
     {
-      if (token->type == LBRACKET) // 数组
-      {
-        TreeNode *tp = newExpNode(IdArrK, Integer, token->lineno);
-        tp->attr.name = idName;
-        match(LBRACKET);
-        TreeNode *tt = expression();
-        tp->child[0] = tt;
-        match(RBRACKET);
-        if (token->type == ASSIGN) // 数组下标赋值语句
-        {
-          tr = newStmtNode(ASSIGNK, token->lineno);
-          tr->child[0] = tp;
-          match(ASSIGN);
-          tr->child[1] = expression();
-          return tr;
-        }
-        else
-        {
-          token = backpoint;
-          tr = simple_exp();
-          return tr;
-        }
-      }
-      else // simple expression
-      {
-        unmatch();
-        tr = simple_exp();
-        return tr;
-      }
+      int i;
+      for (i = 0; i < llYield[n]; i++)
+        pushValue(ps, NULL, 0);
+      for (i = 0; i > llYield[n]; i--)
+        popValue(ps);
     }
   }
+  else if (ps->recognize)
+    pushPredicted(ps, llPredict[n][TOKENTYPE(ps->cx, ps->token)] - 1);
   else
   {
-    tr = simple_exp();
-    return tr;
+    int i;
+    p--;
+    /* the first symbol of the production goes on top */
+    for (i = llRhsStart[p + 1] - 1; i >= llRhsStart[p]; i--)
+    {
+      if (ps->symbolTop == ps->symbolCapacity)
+        growStacks(ps, 1);
+      ps->symbols[ps->symbolTop++] = llRhs[i];
+    }
   }
 }
 
-TreeNode *simple_exp()
+/* runParser parses one start from the current token
+ * and returns the node its actions built
+ */
+static TreeNode *runParser(ParseState *ps, int start)
 {
-  TreeNode *tr = additive_exp();
-  while (token->type == LE || token->type == LT || token->type == GT || token->type == GE ||
-         token->type == EQ || token->type == NE)
+  ps->symbolTop = ps->valueTop = ps->operatorTop = 0;
+  growStacks(ps, 1);
+  ps->symbols[ps->symbolTop++] = LL_NT + start;
+  while (ps->symbolTop > 0 && !ps->gaveUp)
   {
-    TreeNode *p = newExpNode(OpK, Integer, token->lineno);
-    if (p != NULL)
-    {
-      p->child[0] = tr;
-      p->attr.op = token->type;
-      match(token->type);
-      p->child[1] = additive_exp();
-      tr = p;
-    }
+    int s = ps->symbols[--ps->symbolTop];
+    if (s < LL_NT)
+      match(ps, (TokenType)s);
+    else if (s < LL_ACT)
+      expand(ps, s - LL_NT);
+    else
+      runAction(ps, s - LL_ACT);
   }
-  return tr;
+  return ps->valueTop > 0 ? ps->values[0].node : NULL;
 }
 
-TreeNode *additive_exp()
+/* recognize runs start as runParser does, but without
+ * the actions. The common steps are done in line:
+ * matching a token, and expanding a nonterminal the
+ * table has a production for, together with all the
+ * expansions that follow it on the same token (see
+ * llPredict). Errors go through match and expand, so
+ * they are reported just as runParser reports them
+ */
+static void recognize(ParseState *ps, int start)
 {
-  TreeNode *tr = term();
-  while (token->type == PLUS || token->type == SUB)
+  CompileContext *cx = ps->cx;
+  int s, p;
+  TokenType t;
+  ps->recognize = TRUE;
+  ps->symbolTop = ps->valueTop = 0;
+  growStacks(ps, 1);
+  ps->symbols[ps->symbolTop++] = LL_NT + start;
+  while (ps->symbolTop > 0 && !ps->gaveUp)
   {
-    TreeNode *p = newExpNode(OpK, Integer, token->lineno);
-    if (p != NULL)
+    s = ps->symbols[--ps->symbolTop];
+    t = TOKENTYPE(cx, ps->token);
+    if (s == (int)t && t != ENDFILE && ps->recovering == 0)
     {
-      p->child[0] = tr;
-      p->attr.op = token->type;
-      tr = p;
-      match(token->type);
-      p->child[1] = term();
+      if (++ps->token == cx->TokenTable.count)
+        getNextToken(cx);
     }
+    else if (s < LL_NT)
+      match(ps, (TokenType)s);
+    else if ((p = llPredict[s - LL_NT][t]) != 0)
+      pushPredicted(ps, p - 1);
+    else
+      expand(ps, s - LL_NT);
   }
-  return tr;
 }
 
-TreeNode *term()
+/* releaseStacks frees the stacks of ps */
+static void releaseStacks(ParseState *ps)
+{
+  free(ps->symbols);
+  free(ps->values);
+  free(ps->operators);
+  ps->symbols = NULL;
+  ps->values = NULL;
+  ps->operators = NULL;
+  ps->symbolTop = ps->symbolCapacity = ps->valueTop = ps->valueCapacity = 0;
+  ps->operatorTop = ps->operatorCapacity = 0;
+}
+
+/* startParse readies ps to parse the tokens of cx
+   from token begin */
+static void startParse(ParseState *ps, CompileContext *cx, int begin)
+{
+  memset(ps, 0, sizeof(ParseState));
+  ps->cx = cx;
+  ps->token = begin;
+  /* without a prior scan() tokens are pulled on demand */
+  if (cx->TokenTable.count == 0)
+    getNextToken(cx);
+}
+
+/****************************************/
+/* the primary function of the parser   */
+/****************************************/
+/* Function parse returns the newly
+ * constructed syntax tree
+ */
+TreeNode *parse(CompileContext *cx)
 {
-  TreeNode *t = factor();
-  while (token->type == MUL || token->type == DIV)
+  ParseState state;
+  ParseState *ps = &state;
+  TreeNode *t;
+  startParse(ps, cx, 0);
+  t = runParser(ps, NT_program);
+  releaseStacks(ps);
+  if (TOKENTYPE(ps->cx, ps->token) != ENDFILE && !ps->gaveUp)
   {
-    TreeNode *p = newExpNode(OpK, Integer, token->lineno);
-    if (p != NULL)
-    {
-      p->child[0] = t;
-      p->attr.op = token->type;
-      t = p;
-      match(token->type);
-      p->child[1] = factor();
-    }
+    syntaxError(ps, "Code ends before file\n");
   }
   return t;
 }
 
-TreeNode *factor()
+/* Function checkSyntax runs the grammar of parse()
+ * as a recognizer: the same errors are reported, but
+ * no action runs, so no node is made
+ */
+int checkSyntax(CompileContext *cx)
 {
-  TreeNode *t = NULL;
-  char *idName = token->tokenString;
-  char *errMsg;
-  switch (token->type)
+  ParseState state;
+  ParseState *ps = &state;
+  startParse(ps, cx, 0);
+  recognize(ps, NT_program);
+  releaseStacks(ps);
+  if (TOKENTYPE(ps->cx, ps->token) != ENDFILE && !ps->gaveUp)
   {
-  case LPAREN:
-    match(LPAREN);
-    t = expression();
-    match(RPAREN);
-    break;
-  case NUM:
-    t = newExpNode(ConstK, Integer, token->lineno);
-    t->attr.val = atoi(token->tokenString);
-    match(NUM);
-    break;
-  case ID:
-    match(ID);
-    if (token->type == LBRACKET)
-    { //Id [expression]
-      match(LBRACKET);
-      t = newExpNode(IdArrK, Integer, token->lineno);
-      t->child[0] = expression();
-      t->attr.name = idName;
-      match(RBRACKET);
-    }
-    else if (token->type == LPAREN)
-    { // call
-      match(LPAREN);
-      t = newExpNode(CallK, Integer, token->lineno);
-      t->attr.name = idName;
-      t->child[0] = args();
-      match(RPAREN);
-    }
-    else
-    { // ID
-      t = newExpNode(IdK, Integer, token->lineno);
-      t->attr.name = idName;
-    }
-    break;
-  default:
-    // error
-    sscanf(errMsg, "unknonw token %s", token->tokenString);
-    syntaxError(errMsg);
-    break;
+    syntaxError(ps, "Code ends before file\n");
   }
-  return t;
+  return cx->errorCount;
 }
 
-TreeNode *args()
+/* Procedure parseEach parses like parse(), but one
+ * top-level declaration at a time: each is handed
+ * to parsed as soon as it is parsed, then its nodes
+ * are released, so at most one declaration is ever
+ * held as TreeNodes. It runs the grammar of parse(),
+ * so it recovers from errors just as parse() does
+ */
+void parseEach(CompileContext *cx, void (*parsed)(void *arg, TreeNode *decl), void *arg)
 {
-  TreeNode *tr = NULL;
-  if (token->type == RPAREN)
-  { // empty arg
-  }
-  else
+  ParseState state;
+  ParseState *ps = &state;
+  startParse(ps, cx, 0);
+  ps->parsed = parsed;
+  ps->parsedArg = arg;
+  runParser(ps, NT_program);
+  releaseStacks(ps);
+  if (TOKENTYPE(ps->cx, ps->token) != ENDFILE && !ps->gaveUp)
   {
-    TreeNode *p = expression();
-    tr = p;
-    while (token->type == COMMA)
-    {
-      match(COMMA);
-      TreeNode *q = expression();
-      p->sibling = q;
-      p = q;
-    }
+    syntaxError(ps, "Code ends before file\n");
   }
-  return tr;
 }
 
-static void syntaxError(char *message)
+/* appendDecl is the parseEach callback of parseFlat */
+static void appendDecl(void *arg, TreeNode *decl)
 {
-  fprintf(listing, "\n>>> ");
-  fprintf(listing, "Syntax error at line %d: %s", token->lineno, message);
-  Error = TRUE;
+  appendFlatTree((FlatTree *)arg, decl);
 }
 
-static void match(TokenType expected)
+/* Procedure parseFlat parses like parse() into ft,
+ * flattening each declaration as it is parsed
+ */
+void parseFlat(CompileContext *cx, FlatTree *ft)
 {
-  if (token->type == expected && token->next != NULL){
-    token = token->next;
-  } else if (token->type == ERROR) {
-    token= token->next;
-  }
-  else
+  parseEach(cx, appendDecl, ft);
+}
+
+/* Function parseDeclarations parses top-level
+ * declarations quietly from token begin, handing
+ * each to parsed with the tokens it spans, until
+ * parsed returns TRUE or ENDFILE is reached. A
+ * syntax error stops it too: parsed gets a NULL
+ * declaration ending past the token in error, and
+ * FALSE is returned
+ */
+int parseDeclarations(CompileContext *cx, int begin,
+                      int (*parsed)(void *arg, int begin, int end, TreeNode *decl), void *arg)
+{
+  ParseState state;
+  ParseState *ps = &state;
+  TreeNode *t;
+  int start;
+  startParse(ps, cx, begin);
+  ps->quiet = TRUE;
+  for (;;)
   {
-    syntaxError("unexpected token -> ");
-    printToken(token->type, tokenString);
-    fprintf(listing, "      ");
+    start = (int)ps->token;
+    if (TOKENTYPE(ps->cx, ps->token) == ENDFILE)
+      break;
+    t = runParser(ps, NT_declaration);
+    if (ps->error)
+    {
+      parsed(arg, start, (int)(TOKENTYPE(ps->cx, ps->token) == ENDFILE ? ps->token : ps->token + 1), NULL);
+      break;
+    }
+    if (parsed(arg, start, (int)ps->token, t))
+      break;
   }
+  releaseStacks(ps);
+  return !ps->error;
 }
 
-static void unmatch()
+/**************************************************/
+/***********   parallel parsing         ************/
+/**************************************************/
+
+/* MINSLICE = fewest tokens worth a thread */
+#define MINSLICE 65536
+
+/* MAXSLICES = most slices parseParallel makes */
+#define MAXSLICES 64
+
+/* a Slice is a run of whole top-level declarations,
+   tokens begin up to end, parsed by one thread */
+typedef struct slice
+{
+  int begin, end;
+  TreeNode *first, *last; /* its declarations */
+  /* a copy of the context with nodes of its own */
+  CompileContext cx;
+  Arena arena;
+  ParseState state;
+  pthread_t thread;
+} Slice;
+
+/* parseSlice parses the declarations of one slice
+   quietly; it fails if one does not parse or they
+   do not end exactly where the slice does */
+static void *parseSlice(void *arg)
 {
-  if (token->pre->pre != NULL)
+  Slice *sl = (Slice *)arg;
+  ParseState *ps = &sl->state;
+  TreeNode *t;
+  startParse(ps, &sl->cx, sl->begin);
+  ps->quiet = TRUE;
+  sl->first = sl->last = NULL;
+  while (ps->token < sl->end && !ps->error)
   {
-    token = token->pre;
+    t = runParser(ps, NT_declaration);
+    if (t == NULL)
+      break;
+    if (sl->first == NULL)
+      sl->first = t;
+    else
+      sl->last->sibling = t;
+    sl->last = t;
   }
+  if (ps->token != sl->end)
+    ps->error = TRUE;
+  releaseStacks(ps);
+  return arg;
 }
 
-static void assignName(char *destination, char *source)
+/* nextBoundary returns the first end of a top-level
+   declaration at or past token target: the token
+   after a ';' or a '}' back at brace depth zero.
+   Token i must start a declaration */
+static int nextBoundary(const TokenStore *ts, int i, int target, int last)
 {
-  destination = (char *)malloc(sizeof(char) * (MAXTOKENLEN + 1));
-  strcpy(destination, source);
+  int depth = 0;
+  for (; i < last; i++)
+  {
+    TokenType t = ts->type[i];
+    if (t == LBRACE)
+      depth++;
+    else if (t == RBRACE && depth > 0)
+      depth--;
+    else if (t != SEMI)
+      continue;
+    if (depth == 0 && i + 1 >= target)
+      return i + 1;
+  }
+  return last;
 }
 
-/****************************************/
-/* the primary function of the parser   */
-/****************************************/
-/* Function parse returns the newly
- * constructed syntax tree
+/* Function parseParallel returns the tree parse()
+ * would, parsing slices of top-level declarations
+ * on up to threads threads (one per CPU if 0). The
+ * slices are cut at declaration boundaries found by
+ * brace depth; if any slice has a syntax error, the
+ * whole file is parsed again by parse() so errors
+ * are reported just as it reports them
  */
-TreeNode *parse(void)
+TreeNode *parseParallel(CompileContext *cx, int threads)
 {
-  TreeNode *t;
-  token = TokenTable->next;
-  t = program();
-  if (token->type != ENDFILE)
+  Slice *slices;
+  TokenStore *tt = &cx->TokenTable;
+  int i, n, last, failed;
+  TreeNode *first = NULL, *tail = NULL;
+#ifdef _SC_NPROCESSORS_ONLN
+  if (threads <= 0)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (threads > MAXSLICES)
+    threads = MAXSLICES;
+  /* only a whole scanned file can be cut up */
+  last = tt->count - 1;
+  if (last < 0 || tt->first != 0 || TOKENTYPE(cx, last) != ENDFILE)
+    return parse(cx);
+  if (threads > last / MINSLICE)
+    threads = last / MINSLICE;
+  if (threads < 2)
+    return parse(cx);
+  slices = (Slice *)malloc(threads * sizeof(Slice));
+  if (slices == NULL)
+    return parse(cx);
+
+  /* cut at the first boundary past each even share */
+  for (n = 0, i = 0; i < threads; i++)
+  {
+    int b = (n == 0) ? 0 : slices[n - 1].end;
+    int e = (i == threads - 1) ? last : nextBoundary(tt, b, (int)((long long)last * (i + 1) / threads), last);
+    if (e <= b)
+      continue;
+    memset(&slices[n], 0, sizeof(Slice));
+    slices[n].begin = b;
+    slices[n].end = e;
+    slices[n].cx = *cx;
+    slices[n].cx.nodes = &slices[n].arena;
+    n++;
+    if (e == last)
+      break;
+  }
+
+  for (i = 1; i < n; i++)
+    if (pthread_create(&slices[i].thread, NULL, parseSlice, &slices[i]) != 0)
+    {
+      fprintf(stderr, "unable to start a parse thread\n");
+      exit(1);
+    }
+  parseSlice(&slices[0]);
+  for (i = 1; i < n; i++)
+    pthread_join(slices[i].thread, NULL);
+
+  for (failed = FALSE, i = 0; i < n; i++)
   {
-    syntaxError("Code ends before file\n");
+    failed |= slices[i].state.error;
+    arenaAdopt(cx->nodes, &slices[i].arena);
+    if (slices[i].first == NULL)
+      continue;
+    if (first == NULL)
+      first = slices[i].first;
+    else
+      tail->sibling = slices[i].first;
+    tail = slices[i].last;
   }
-  return t;
+  free(slices);
+  if (failed)
+  {
+    releaseSyntaxTree(cx);
+    return parse(cx);
+  }
+  return first;
 }
@@ -8,10 +8,56 @@
 #ifndef _PARSE_H_
 #define _PARSE_H_
 #include "globals.h"
+#include "flattree.h"
+
+/* MaxErrors is the number of syntax errors after
+ * which parsing stops, 0 meaning no limit
+ */
+extern int MaxErrors;
 
 /* Function parse returns the newly 
  * constructed syntax tree
  */
-TreeNode * parse(void);
+TreeNode * parse(CompileContext *cx);
+
+/* Function checkSyntax only checks the syntax: it
+ * reports what parse() would, but builds no tree,
+ * and returns the number of syntax errors
+ */
+int checkSyntax(CompileContext *cx);
+
+/* Procedure parseEach parses like parse(), but
+ * hands each top-level declaration to parsed as
+ * soon as it is parsed and releases its nodes when
+ * parsed returns, holding only one declaration at a
+ * time as TreeNodes
+ */
+void parseEach(CompileContext *cx, void (*parsed)(void *arg, TreeNode *decl), void *arg);
+
+/* Procedure parseFlat parses into the compact tree
+ * ft instead, holding only one declaration at a
+ * time as TreeNodes
+ */
+void parseFlat(CompileContext *cx, FlatTree *ft);
+
+/* Function parseDeclarations parses the top-level
+ * declarations from token begin of a scanned file,
+ * reporting nothing. Each is handed to parsed with
+ * the tokens begin up to end it spans; parsing stops
+ * when parsed returns TRUE or at the end of the file.
+ * At the first syntax error parsed is handed NULL,
+ * with end just past the token in error, and FALSE
+ * is returned
+ */
+int parseDeclarations(CompileContext *cx, int begin,
+                      int (*parsed)(void *arg, int begin, int end, TreeNode *decl), void *arg);
+
+/* Function parseParallel returns the tree parse()
+ * would, parsing runs of top-level declarations on
+ * up to threads threads (one per CPU if 0). It
+ * needs the whole file scanned into TokenTable
+ * first and otherwise just calls parse()
+ */
+TreeNode *parseParallel(CompileContext *cx, int threads);
 
 #endif
@@ -8,373 +8,1301 @@
 #include "scan.h"
 #include "globals.h"
 #include "util.h"
+#include "intern.h"
+#include "simdscan.h"
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
 
-/* states in scanner DFA */
-// TODO: 要添加一些状态 !done
-typedef enum
-{
-  START,
-  INEQUAL,
-  INGT,
-  INLT,
-  INEXCLA,
-  INCOMMENTORDIV,
-  OUTCOMMENT,
-  INCOMMENT,
-  INNUM,
-  INID,
-  DONE
-} StateType;
-
-TokenNode *TokenTable;
-
-/* lexeme of identifier or reserved word */
-char tokenString[MAXTOKENLEN + 1];
-
-/* BUFLEN = length of the input buffer for
-   source code lines */
-#define BUFLEN 256
-
-static char lineBuf[BUFLEN]; /* holds the current line */
-static int linepos = 0;      /* current position in LineBuf */
-static int bufsize = 0;      /* current size of buffer string */
-static int EOF_flag = FALSE; /* corrects ungetNextChar behavior on EOF */
-
-/* getNextChar fetches the next non-blank character
-   from lineBuf, reading in a new line if lineBuf is
-   exhausted */
-static int getNextChar(void)
-{
-  if (!(linepos < bufsize))
-  {
-    lineno++;
-    if (fgets(lineBuf, BUFLEN - 1, source))
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* charClass, symbolToken, symbolSecond and symbolPair
+   are generated from tokens.def */
+#include "scantab.h"
+
+/* ScanState is the position of one scanner in
+   srcBuf and what it found there: getToken runs one
+   over the whole buffer, scanParallel one per chunk */
+typedef struct scanState
+{
+  const unsigned char *pos; /* next character to be scanned */
+  const unsigned char *end; /* one past the last one */
+  int lineno;               /* line number of pos */
+  int echo;                 /* TRUE to echo lines as entered */
+  InternTable *symbols;     /* where to intern identifiers, or NULL */
+  const struct scanKernels *kernels;
+  CompileContext *cx;
+  char *tokenBegin;         /* span of the most recent token */
+  char *tokenEnd;
+  /* symbol id of the most recent ID token,
+     value of the most recent NUM token */
+  int attr;
+} ScanState;
+
+/* Scanner is the scanner state of one CompileContext */
+typedef struct scanner
+{
+  /* the whole source file is held in one contiguous
+     buffer: mapped with mmap when source is a regular
+     file, otherwise (pipes, stdin) read in one piece.
+     getToken lexes directly out of this buffer */
+  char *srcBuf;   /* start of the source text */
+  char *srcEnd;   /* one past the last character */
+  size_t srcSize; /* size of srcBuf */
+  int srcMapped;  /* TRUE if srcBuf came from mmap */
+  int srcBorrowed; /* TRUE if srcBuf is the caller's */
+  size_t srcCapacity; /* bytes malloc'd for srcBuf once edited */
+  size_t srcDropped;  /* mapped bytes given back while streaming */
+  ScanState mainScan;
+  /* TRUE when TokenTable is a ring of recent tokens
+     filled by getNextToken rather than the whole
+     token stream filled by scan() */
+  int streaming;
+  /* TRUE to leave identifiers uninterned */
+  int noNames;
+  /* tokens from tokenPin on may not be dropped */
+  long long tokenPin;
+  /* the scan thread of --pipeline, see below */
+  int pipelined;
+  pthread_t scanThread;
+  pthread_mutex_t pipeLock;
+  pthread_cond_t pipeCond;
+  long long published;
+  long long released;
+  int scannerWaiting;
+  int parserWaiting;
+  int stopScanning;
+} Scanner;
+
+/* scannerOf returns the Scanner of cx, making it on
+   first use */
+static Scanner *scannerOf(CompileContext *cx)
+{
+  Scanner *sc = cx->scanner;
+  if (sc == NULL)
+  {
+    sc = (Scanner *)calloc(1, sizeof(Scanner));
+    if (sc == NULL)
     {
-      if (EchoSource)
-        fprintf(listing, "%4d: %s", lineno, lineBuf);
-      bufsize = strlen(lineBuf);
-      linepos = 0;
-      return lineBuf[linepos++];
+      fprintf(stderr, "Out of memory error starting the scanner\n");
+      exit(1);
     }
-    else
+    sc->tokenPin = LLONG_MAX;
+    pthread_mutex_init(&sc->pipeLock, NULL);
+    pthread_cond_init(&sc->pipeCond, NULL);
+    cx->scanner = sc;
+  }
+  return sc;
+}
+
+/* READCHUNK = initial size of the buffer used when
+   the source can not be mapped */
+#define READCHUNK 65536
+
+/* DROPBYTES = mapped source bytes already streamed
+   past that are given back to the system at once */
+#define DROPBYTES (4 << 20)
+
+/* highest KERNEL_ level getToken may use */
+int ScanKernelLevel = KERNEL_AVX2;
+
+/* kernels getToken uses for comment text and for
+   runs of white space, letters and digits longer
+   than SHORTRUN characters; chosen once, as every
+   context may use them */
+#define SHORTRUN 16
+static const ScanKernels *kernels = NULL;
+static pthread_once_t kernelsChosen = PTHREAD_ONCE_INIT;
+
+/* scalar kernels driven by the charClass table */
+static const unsigned char *skipSpaceTable(const unsigned char *p, const unsigned char *end, int *lines)
+{
+  int n = 0;
+  while (p < end && charClass[*p] == CC_SPACE)
+    n += (*p++ == '\n');
+  *lines = n;
+  return p;
+}
+
+static const unsigned char *commentEndTable(const unsigned char *p, const unsigned char *end, int *lines)
+{
+  int n = 0;
+  while (p < end && !(p[0] == '*' && p + 1 < end && p[1] == '/'))
+    n += (*p++ == '\n');
+  *lines = n;
+  return p;
+}
+
+static const unsigned char *letterRunTable(const unsigned char *p, const unsigned char *end)
+{
+  while (p < end && charClass[*p] == CC_LETTER)
+    p++;
+  return p;
+}
+
+static const unsigned char *digitRunTable(const unsigned char *p, const unsigned char *end)
+{
+  while (p < end && charClass[*p] == CC_DIGIT)
+    p++;
+  return p;
+}
+
+static const ScanKernels tableKernels = {
+    skipSpaceTable, commentEndTable, letterRunTable, digitRunTable, KERNEL_SCALAR};
+
+/* chooseKernels picks the vector kernels when the CPU
+   has them and their character sets agree with the
+   ones generated from tokens.def */
+static void chooseKernels(void)
+{
+  static const int kernelClass[] = {CC_OTHER, CC_SPACE, CC_LETTER, CC_DIGIT};
+  int c;
+  kernels = NULL;
+  for (c = 0; c < 256; c++)
+  {
+    int cls = charClass[c];
+    if (cls != CC_SPACE && cls != CC_LETTER && cls != CC_DIGIT)
+      cls = CC_OTHER;
+    if (kernelClass[kernelCharClass(c)] != cls)
+      break;
+  }
+  if (c == 256)
+    kernels = selectScanKernels(ScanKernelLevel);
+  if (kernels == NULL)
+    kernels = &tableKernels;
+}
+
+/* enterLine counts the source line starting at p,
+   echoing it if st->echo is set */
+static void enterLine(ScanState *st, const char *p)
+{
+  st->lineno++;
+  if (st->echo && p < (const char *)st->end)
+  {
+    const char *end = (const char *)st->end;
+    const char *e = (const char *)memchr(p, '\n', end - p);
+    e = (e == NULL) ? end : e + 1;
+    fprintf(st->cx->listing, "%4d: %.*s", st->lineno, (int)(e - p), p);
+  }
+}
+
+/* enterLines counts the lines entered between
+   from and to, echoing each if st->echo is set */
+static void enterLines(ScanState *st, const char *from, const char *to, int lines)
+{
+  if (!st->echo)
+    st->lineno += lines;
+  else
+    while ((from = (const char *)memchr(from, '\n', to - from)) != NULL)
+      enterLine(st, ++from);
+}
+
+/* startMainScan points getToken at the first
+   line of srcBuf */
+static void startMainScan(CompileContext *cx)
+{
+  Scanner *sc = cx->scanner;
+  ScanState *st = &sc->mainScan;
+  st->pos = (const unsigned char *)sc->srcBuf;
+  st->end = (const unsigned char *)sc->srcEnd;
+  st->lineno = cx->lineno;
+  st->echo = EchoSource && cx->listing != NULL;
+  st->symbols = sc->noNames ? NULL : cx->symbols;
+  st->kernels = kernels;
+  st->cx = cx;
+  enterLine(st, sc->srcBuf);
+  cx->lineno = st->lineno;
+}
+
+/* loadSource makes the whole source file available
+   in srcBuf */
+static void loadSource(CompileContext *cx)
+{
+  Scanner *sc = scannerOf(cx);
+  size_t cap, n;
+  pthread_once(&kernelsChosen, chooseKernels);
+#ifndef _WIN32
+  struct stat st;
+  int fd = fileno(cx->source);
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+  {
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
     {
-      EOF_flag = TRUE;
-      return EOF;
+      madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+      sc->srcBuf = (char *)p;
+      sc->srcSize = (size_t)st.st_size;
+      sc->srcMapped = TRUE;
+      sc->srcEnd = sc->srcBuf + sc->srcSize;
+      startMainScan(cx);
+      return;
     }
   }
-  else
-    return lineBuf[linepos++];
+#endif
+  /* not mappable: read everything, doubling the buffer */
+  cap = READCHUNK;
+  sc->srcSize = 0;
+  sc->srcBuf = (char *)malloc(cap);
+  while (sc->srcBuf != NULL && (n = fread(sc->srcBuf + sc->srcSize, 1, cap - sc->srcSize, cx->source)) > 0)
+  {
+    sc->srcSize += n;
+    if (sc->srcSize == cap)
+    {
+      cap *= 2;
+      sc->srcBuf = (char *)realloc(sc->srcBuf, cap);
+    }
+  }
+  if (sc->srcBuf == NULL)
+  {
+    fprintf(stderr, "Out of memory error reading source\n");
+    sc->srcSize = 0;
+  }
+  sc->srcMapped = FALSE;
+  sc->srcEnd = sc->srcBuf + sc->srcSize;
+  startMainScan(cx);
 }
 
-/* ungetNextChar backtracks one character
-   in lineBuf */
-static void ungetNextChar(void)
+/* useSourceBuffer makes the size characters of text
+   the source of cx in place of cx->source */
+void useSourceBuffer(CompileContext *cx, const char *text, size_t size)
 {
-  if (!EOF_flag)
-    linepos--;
+  Scanner *sc = scannerOf(cx);
+  pthread_once(&kernelsChosen, chooseKernels);
+  if (text == NULL)
+    text = "", size = 0;
+  sc->srcBuf = (char *)text;
+  sc->srcSize = size;
+  sc->srcEnd = sc->srcBuf + size;
+  sc->srcMapped = FALSE;
+  sc->srcBorrowed = TRUE;
+  startMainScan(cx);
 }
 
-/* lookup table of reserved words */
-// TODO: need to remove and add some reserved words !done
-static struct
+/* sourceText returns the source text of cx, loading
+   it if getToken has not yet */
+const char *sourceText(CompileContext *cx, size_t *size)
 {
-  char *str;
-  TokenType tok;
-} reservedWords[MAXRESERVED] = {{"if", IF}, {"int", INT}, {"else", ELSE}, {"void", VOID}, {"return", RETURN}, {"while", WHILE}};
+  if (cx->scanner == NULL || cx->scanner->mainScan.pos == NULL)
+    loadSource(cx);
+  *size = cx->scanner->srcSize;
+  return cx->scanner->srcBuf;
+}
+
+/* releaseSource unmaps or frees the source buffer,
+   and with it the rest of the scanner */
+void releaseSource(CompileContext *cx)
+{
+  Scanner *sc = cx->scanner;
+  if (sc == NULL)
+    return;
+  stopScanThread(cx);
+#ifndef _WIN32
+  if (sc->srcMapped)
+    munmap(sc->srcBuf, sc->srcSize);
+  else
+#endif
+    if (!sc->srcBorrowed)
+      free(sc->srcBuf);
+  pthread_mutex_destroy(&sc->pipeLock);
+  pthread_cond_destroy(&sc->pipeCond);
+  free(sc);
+  cx->scanner = NULL;
+}
 
-/* lookup an identifier to see if it is a reserved word */
-/* uses linear search */
+/* kwTable is a collision-free hash table of the
+   reserved words, generated from keywords.def */
+#include "kwhash.h"
+
+/* lookup the n-character identifier s to see if it
+   is a reserved word: one table probe and one memcmp */
 
 // 查找是哪一种保留字, 或者返回为标识符.
-static TokenType reservedLookup(char *s)
+static TokenType reservedLookup(const char *s, int n)
 {
-  int i;
-  for (i = 0; i < MAXRESERVED; i++)
-    if (!strcmp(s, reservedWords[i].str))
-      return reservedWords[i].tok;
+  unsigned int h;
+  if (n < KW_MINLEN || n > KW_MAXLEN)
+    return ID;
+  h = KWHASH(s, n);
+  if (kwTable[h].len == n && memcmp(kwTable[h].str, s, n) == 0)
+    return kwTable[h].tok;
   return ID;
 }
 
-/****************************************/
-/* the primary function of the scanner  */
-/****************************************/
-/* function getToken returns the
- * next token in source file
+/* lexToken scans the next token of st, leaving
+ * its span in st->tokenBegin and st->tokenEnd
+ * and its symbol id or value in st->attr. It is
+ * coded directly over the source buffer,
+ * dispatching on the character class tables
+ * of scantab.h
  */
-TokenType getToken(void)
+static TokenType lexToken(ScanState *st)
 {
-  /* index for storing into tokenString */
-  int tokenStringIndex = 0;
   /* holds current token to be returned */
   TokenType currentToken;
-  /* current state - always begins at START */
-  StateType state = START;
-  /* flag to indicate save to tokenString */
-  int save;
-  // 双层case嵌套
-  while (state != DONE)
-  {
-    int c = getNextChar();
-    save = TRUE;
-    switch (state)
+  const unsigned char *p, *q, *end;
+  int lines;
+  p = st->pos;
+  end = st->end;
+
+  /* skip white space and comments */
+  for (;;)
+  {
+    /* short runs are skipped in line, long ones are
+       handed to the kernel */
+    for (q = p; q < end && q - p < SHORTRUN && charClass[*q] == CC_SPACE; q++)
+      if (*q == '\n')
+        enterLine(st, (const char *)q + 1);
+    if (q - p == SHORTRUN)
     {
-    case START:
-      if (isdigit(c))
-        state = INNUM;
-      else if (isalpha(c))
-        state = INID;
-      else if (c == '=')
-        state = INEQUAL;
-      else if ((c == ' ') || (c == '\t') || (c == '\n'))
-        save = FALSE;
-      else if (c == '/')
-      {
-        save = FALSE;
-        state = INCOMMENTORDIV;
-      }
-      else if (c == '>')
-      {
-        state = INGT;
-      }
-      else if (c == '<')
-      {
-        state = INLT;
-      }
-      else if (c == '!')
+      p = q;
+      q = st->kernels->skipSpace(p, end, &lines);
+      if (lines)
+        enterLines(st, (const char *)p, (const char *)q, lines);
+    }
+    p = q;
+    if (p + 1 < end && p[0] == '/' && p[1] == '*') // 注释
+    {
+      p += 2;
+      q = st->kernels->commentEnd(p, end, &lines);
+      if (lines)
+        enterLines(st, (const char *)p, (const char *)q, lines);
+      p = q;
+      if (p == end)
       {
-        state = INEXCLA;
-      }
-      else
-      {
-        state = DONE;
-        switch (c)
-        {
-        case EOF:
-          save = FALSE;
-          currentToken = ENDFILE;
-          break;
-        case '+':
-          currentToken = PLUS;
-          break;
-        case '-':
-          currentToken = SUB;
-          break;
-        case '*':
-          currentToken = MUL;
-          break;
-        case '(':
-          currentToken = LPAREN;
-          break;
-        case ')':
-          currentToken = RPAREN;
-          break;
-        case ';':
-          currentToken = SEMI;
-          break;
-        case '[':
-          currentToken = LBRACKET;
-          break;
-        case ']':
-          currentToken = RBRACKET;
-          break;
-        case '{':
-          currentToken = LBRACE;
-          break;
-        case '}':
-          currentToken = RBRACE;
-          break;
-        case ',':
-          currentToken = COMMA;
-          break;
-        default:
-          currentToken = ERROR;
-          break;
-        }
+        st->tokenBegin = st->tokenEnd = (char *)end;
+        st->pos = end;
+        return ERRORENDFILE;
       }
+      p += 2;
+      continue;
+    }
+    break;
+  }
+
+  st->tokenBegin = (char *)p;
+  st->attr = 0;
+  if (p == end)
+    currentToken = ENDFILE;
+  else
+  {
+    switch (charClass[*p])
+    {
+    case CC_LETTER: // 标识符
+      for (q = p + 1; q < end && q - p < SHORTRUN && charClass[*q] == CC_LETTER; q++)
+        ;
+      if (q - p == SHORTRUN)
+        q = st->kernels->letterRun(q, end);
+      p = q;
+      // 查看是否为保留字
+      currentToken = reservedLookup(st->tokenBegin, (int)((char *)p - st->tokenBegin));
+      if (currentToken == ID)
+        st->attr = st->symbols ? internName(st->symbols, st->tokenBegin, (int)((char *)p - st->tokenBegin)) : NOSYMBOL;
       break;
-    case INCOMMENTORDIV: // 注释
-      save = FALSE;
-      if (c == '*')
-      {
-        state = INCOMMENT;
-      }
-      else
+    case CC_DIGIT: // 数字
+      for (q = p + 1; q < end && q - p < SHORTRUN && charClass[*q] == CC_DIGIT; q++)
+        ;
+      if (q - p == SHORTRUN)
+        q = st->kernels->digitRun(q, end);
       {
-        ungetNextChar();
-        tokenString[tokenStringIndex++] = (char)'/';
-        currentToken = DIV;
-        state = DONE;
+        /* a constant too large for an int is INT_MAX */
+        unsigned long long value = 0;
+        for (; p < q; p++)
+          if ((value = value * 10 + (*p - '0')) > INT_MAX)
+            value = INT_MAX;
+        st->attr = (int)value;
       }
+      currentToken = NUM;
       break;
-    case INCOMMENT:
-      save = FALSE;
-      if (c == '*')
-      {
-        state = OUTCOMMENT;
-      }
-      else if (c == EOF)
-      {
-        state = DONE;
-        currentToken = ERRORENDFILE;
-      }
+    case CC_SYMBOL:
+      currentToken = symbolToken[*p++];
       break;
-    case OUTCOMMENT:
-      save = FALSE;
-      if (c == '/')
-      {
-        state = START;
-      }
-      else if (c == EOF)
+    case CC_SYMBOL2: // <= >= == != 或单字符
+      if (p + 1 < end && p[1] == symbolSecond[*p])
       {
-        state = DONE;
-        currentToken = ERRORENDFILE;
+        currentToken = symbolPair[*p];
+        p += 2;
       }
       else
-      {
-        state = INCOMMENT;
-      }
-      break;
-    case INEQUAL: // 赋值或相等
-      state = DONE;
-      if (c == '=')
-        currentToken = EQ;
-      else
-      { /* backup in the input */
-        save = FALSE;
-        ungetNextChar();
-        currentToken = ASSIGN;
-      }
+        currentToken = symbolToken[*p++];
       break;
-    case INNUM: // 数字
-      if (!isdigit(c))
-      { /* backup in the input */
-        ungetNextChar();
-        save = FALSE;
-        state = DONE;
-        currentToken = NUM;
-      }
-      break;
-    case INID: // 标识符
-      if (!isalpha(c))
-      { /* backup in the input */
-        ungetNextChar();
-        save = FALSE;
-        state = DONE;
-        currentToken = ID;
-      }
-      break;
-    case INGT:
-      state = DONE;
-      if (c == '=')
-      {
-        save = TRUE;
-        currentToken = GE;
-      }
-      else
-      {
-        ungetNextChar();
-        currentToken = GT;
-      }
+    default:
+      currentToken = ERROR;
+      p++;
       break;
-    case INLT:
-      state = DONE;
-      if (c == '=')
+    }
+  }
+  st->tokenEnd = (char *)p;
+  st->pos = p;
+  return currentToken;
+}
+
+/****************************************/
+/* the primary function of the scanner  */
+/****************************************/
+/* function getToken returns the
+ * next token in source file
+ */
+TokenType getToken(CompileContext *cx)
+{
+  /* holds current token to be returned */
+  TokenType currentToken;
+  ScanState *st;
+  if (cx->scanner == NULL || cx->scanner->mainScan.pos == NULL)
+    loadSource(cx);
+  st = &cx->scanner->mainScan;
+  currentToken = lexToken(st);
+  cx->lineno = st->lineno;
+  if (TraceScan && cx->listing != NULL)
+  {
+    int n = (int)(st->tokenEnd - st->tokenBegin);
+    if (n > MAXTOKENLEN)
+      n = MAXTOKENLEN;
+    memcpy(cx->tokenString, st->tokenBegin, n);
+    cx->tokenString[n] = '\0';
+    fprintf(cx->listing, "\t%d: ", cx->lineno);
+    printToken(cx, currentToken, cx->tokenString);
+  }
+  return currentToken;
+} /* end getToken */
+
+/* INITTOKENS = initial capacity of TokenTable */
+#define INITTOKENS 1024
+
+/* TOKENWINDOW = capacity of TokenTable when tokens
+   are streamed to the parser: it only has to hold
+   the parser's backtrack (two tokens) plus any
+   tokens pinned by pinTokens */
+#define TOKENWINDOW 64
+
+/* STREAMBATCH = tokens getNextToken scans at a time
+   when nothing is listed as they are scanned */
+#define STREAMBATCH (TOKENWINDOW / 2)
+
+/* resizeTokenArray moves the tokens first..count-1 of
+   one array of ts into an array of cap slots */
+static void *resizeTokenArray(const TokenStore *ts, void *a, size_t size, int cap)
+{
+  char *old = (char *)a;
+  char *t;
+  long long i;
+  int oldMask = ts->capacity - 1;
+  if (ts->first == 0) /* never wrapped */
+    return realloc(a, cap * size);
+  t = (char *)malloc(cap * size);
+  if (t != NULL)
+    for (i = ts->first; i < ts->count; i++)
+      memcpy(t + (i & (cap - 1)) * size, old + (i & oldMask) * size, size);
+  free(old);
+  return t;
+}
+
+/* growTokenTable doubles the capacity of every
+   array in TokenTable */
+static void growTokenTable(CompileContext *cx)
+{
+  TokenStore *ts = &cx->TokenTable;
+  int cap;
+  if (ts->capacity >= MAXTOKENS)
+  {
+    fprintf(stderr, "Too many tokens at line %d\n", cx->lineno);
+    exit(1);
+  }
+  cap = ts->capacity ? 2 * ts->capacity : (cx->scanner->streaming ? TOKENWINDOW : INITTOKENS);
+  ts->type = (TokenType *)resizeTokenArray(ts, ts->type, sizeof(TokenType), cap);
+  ts->lineno = (int *)resizeTokenArray(ts, ts->lineno, sizeof(int), cap);
+  ts->offset = (size_t *)resizeTokenArray(ts, ts->offset, sizeof(size_t), cap);
+  ts->len = (unsigned int *)resizeTokenArray(ts, ts->len, sizeof(unsigned int), cap);
+  ts->attr = (int *)resizeTokenArray(ts, ts->attr, sizeof(int), cap);
+  if (ts->type == NULL || ts->lineno == NULL ||
+      ts->offset == NULL || ts->len == NULL || ts->attr == NULL)
+  {
+    fprintf(stderr, "Out of memory error at line %d\n", cx->lineno);
+    exit(1);
+  }
+  ts->capacity = cap;
+}
+
+static void storeToken(CompileContext *cx, long long n, TokenType tok);
+
+/* putToken writes the token st just scanned
+   into slot i of the arrays of ts */
+static void putToken(TokenStore *ts, int i, const ScanState *st, TokenType tok)
+{
+  ts->type[i] = tok;
+  ts->lineno[i] = st->lineno;
+  ts->offset[i] = (size_t)(st->tokenBegin - st->cx->scanner->srcBuf);
+  ts->len[i] = (unsigned int)(st->tokenEnd - st->tokenBegin);
+  ts->attr[i] = st->attr;
+}
+
+/* appendToken adds the token just returned by
+   getToken to TokenTable. When streaming, the oldest
+   token is dropped to make room unless it is pinned */
+static void appendToken(CompileContext *cx, TokenType tok)
+{
+  TokenStore *ts = &cx->TokenTable;
+  if (ts->count - ts->first == ts->capacity)
+  {
+    if (cx->scanner->streaming && ts->capacity > 0 && ts->first < cx->scanner->tokenPin)
+      ts->first++;
+    else
+      growTokenTable(cx);
+  }
+  storeToken(cx, ts->count++, tok);
+}
+
+/* storeToken writes the token just returned by
+   getToken into the slot of token number n */
+static void storeToken(CompileContext *cx, long long n, TokenType tok)
+{
+  putToken(&cx->TokenTable, TOKENSLOT(cx, n), &cx->scanner->mainScan, tok);
+}
+
+// 扫描源文件生成符号表
+void scan(CompileContext *cx)
+{
+  TokenType tok;
+  do
+  {
+    tok = getToken(cx);
+    appendToken(cx, tok);
+  } while (tok != ENDFILE);
+}
+
+/**************************************************/
+/*********   parallel chunked scanning    *********/
+/**************************************************/
+/* scanParallel cuts srcBuf into chunks that start
+   at the beginning of a line and lexes them on one
+   thread each. A chunk may start inside a comment,
+   which only the text before it can tell, so it is
+   done in passes:
+     1. each thread counts the lines of its chunk and
+        works out the comment state at its end for
+        either state at its start
+     2. the start states and first line numbers are
+        chained through the chunks in order
+     3. each thread lexes its chunk from its start
+        state and line, into tokens of its own
+   and the chunk tokens are then copied into
+   TokenTable in order, interning identifiers as
+   they go so symbol ids come out as scan() numbers
+   them */
+
+/* MINCHUNK = smallest chunk worth a thread */
+#define MINCHUNK (256 * 1024)
+
+/* MAXCHUNKS = most chunks scanParallel makes */
+#define MAXCHUNKS 64
+
+/* comment states of the summary pass: outside a
+   comment, or inside one, each just after a '/'
+   or '*' that may start or end it */
+#define CS_OUT 0
+#define CS_SLASH 1
+#define CS_IN 2
+#define CS_STAR 3
+
+static unsigned char commentNext[4][256];
+static pthread_once_t commentNextBuilt = PTHREAD_ONCE_INIT;
+
+static void buildCommentNext(void)
+{
+  int c;
+  for (c = 0; c < 256; c++)
+  {
+    commentNext[CS_OUT][c] = (c == '/') ? CS_SLASH : CS_OUT;
+    commentNext[CS_SLASH][c] = (c == '*') ? CS_IN : (c == '/') ? CS_SLASH : CS_OUT;
+    commentNext[CS_IN][c] = (c == '*') ? CS_STAR : CS_IN;
+    commentNext[CS_STAR][c] = (c == '/') ? CS_OUT : (c == '*') ? CS_STAR : CS_IN;
+  }
+}
+
+typedef struct chunk
+{
+  const unsigned char *begin, *end;
+  CompileContext *cx;
+  int last;          /* TRUE for the chunk ending srcBuf */
+  int lines;         /* '\n' in the chunk */
+  int exitOut;       /* comment state at the end when */
+  int exitIn;        /* starting out of / in a comment */
+  int inComment;     /* TRUE if it starts in a comment */
+  int firstLine;     /* line number of begin */
+  TokenStore tokens; /* the tokens of the chunk */
+  pthread_t thread;
+} Chunk;
+
+/* summarizeChunk is pass 1 for one chunk. The two
+   runs of the state machine stay together once they
+   meet, so usually only one is carried far */
+static void *summarizeChunk(void *arg)
+{
+  Chunk *c = (Chunk *)arg;
+  const unsigned char *p = c->begin;
+  int out = CS_OUT, in = CS_IN, lines = 0, merged;
+  for (; p < c->end && out != in; p++)
+  {
+    lines += (*p == '\n');
+    out = commentNext[out][*p];
+    in = commentNext[in][*p];
+  }
+  merged = (out == in);
+  for (; p < c->end; p++)
+  {
+    lines += (*p == '\n');
+    out = commentNext[out][*p];
+  }
+  if (merged)
+    in = out;
+  c->lines = lines;
+  /* chunks end in '\n', so either run ends in or
+     out of a comment, not halfway through a bracket */
+  c->exitOut = (out == CS_IN || out == CS_STAR);
+  c->exitIn = (in == CS_IN || in == CS_STAR);
+  return arg;
+}
+
+/* addToken appends the token st just scanned to
+   the tokens of ts, those of a chunk or the ones
+   relexEdit collects */
+static void addToken(TokenStore *ts, const ScanState *st, TokenType tok)
+{
+  if (ts->count == ts->capacity)
+  {
+    int cap = ts->capacity ? 2 * ts->capacity : INITTOKENS;
+    if (ts->capacity >= MAXTOKENS)
+    {
+      fprintf(stderr, "Too many tokens at line %d\n", st->lineno);
+      exit(1);
+    }
+    ts->type = (TokenType *)realloc(ts->type, cap * sizeof(TokenType));
+    ts->lineno = (int *)realloc(ts->lineno, cap * sizeof(int));
+    ts->offset = (size_t *)realloc(ts->offset, cap * sizeof(size_t));
+    ts->len = (unsigned int *)realloc(ts->len, cap * sizeof(unsigned int));
+    ts->attr = (int *)realloc(ts->attr, cap * sizeof(int));
+    if (ts->type == NULL || ts->lineno == NULL ||
+        ts->offset == NULL || ts->len == NULL || ts->attr == NULL)
+    {
+      fprintf(stderr, "Out of memory error at line %d\n", st->lineno);
+      exit(1);
+    }
+    ts->capacity = cap;
+  }
+  putToken(ts, ts->count++, st, tok);
+}
+
+/* scanChunk is pass 3 for one chunk. Only the last
+   chunk ends at the end of the file, so only it
+   keeps ENDFILE and ERRORENDFILE */
+static void *scanChunk(void *arg)
+{
+  Chunk *c = (Chunk *)arg;
+  ScanState st;
+  TokenType tok;
+  int lines;
+  memset(&st, 0, sizeof(st));
+  st.pos = c->begin;
+  st.end = c->end;
+  st.lineno = c->firstLine;
+  st.kernels = kernels;
+  st.cx = c->cx;
+  if (c->inComment)
+  { /* finish the comment a previous chunk opened */
+    st.pos = kernels->commentEnd(c->begin, c->end, &lines);
+    st.lineno += lines;
+    if (st.pos == c->end)
+    {
+      if (c->last)
       {
-        save = TRUE;
-        currentToken = LE;
+        st.tokenBegin = st.tokenEnd = (char *)c->end;
+        addToken(&c->tokens, &st, ERRORENDFILE);
       }
       else
-      {
-        ungetNextChar();
-        currentToken = LT;
-      }
+        return arg;
+    }
+    else
+      st.pos += 2;
+  }
+  for (;;)
+  {
+    tok = lexToken(&st);
+    if (!c->last && (tok == ENDFILE || tok == ERRORENDFILE))
       break;
-    case INEXCLA:
-      state = DONE;
-      if (c == '=')
-      {
-        save = TRUE;
-        currentToken = NE;
-      }
-      else
-      {
-        ungetNextChar();
-        save = TRUE;
-        currentToken = ERROR;
-      }
+    addToken(&c->tokens, &st, tok);
+    if (tok == ENDFILE)
       break;
-    case DONE:
-    default: /* should never happen */
-      fprintf(listing, "Scanner Bug: state= %d\n", state);
-      state = DONE;
-      currentToken = ERROR;
+  }
+  return arg;
+}
+
+/* runChunks runs fn on every chunk, each on a
+   thread of its own but the first */
+static void runChunks(Chunk *chunks, int n, void *(*fn)(void *))
+{
+  int i;
+  for (i = 1; i < n; i++)
+    if (pthread_create(&chunks[i].thread, NULL, fn, &chunks[i]) != 0)
+    {
+      fprintf(stderr, "unable to start a scan thread\n");
+      exit(1);
+    }
+  fn(&chunks[0]);
+  for (i = 1; i < n; i++)
+    pthread_join(chunks[i].thread, NULL);
+}
+
+void scanParallel(CompileContext *cx, int threads)
+{
+  Chunk chunks[MAXCHUNKS];
+  TokenStore *tt = &cx->TokenTable;
+  Scanner *sc;
+  ScanState *ms;
+  int i, n, inComment, line;
+  long long total;
+  size_t size, step;
+  if (cx->scanner == NULL || cx->scanner->mainScan.pos == NULL)
+    loadSource(cx);
+  sc = cx->scanner;
+  ms = &sc->mainScan;
+#ifdef _SC_NPROCESSORS_ONLN
+  if (threads <= 0)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (threads > MAXCHUNKS)
+    threads = MAXCHUNKS;
+  size = (size_t)(ms->end - ms->pos);
+  if (threads > (int)(size / MINCHUNK))
+    threads = (int)(size / MINCHUNK);
+  /* the listing must come out in order, and only
+     scan() starts from an empty TokenTable at the
+     first line */
+  if (threads < 2 || EchoSource || TraceScan || tt->count > 0 ||
+      ms->pos != (const unsigned char *)sc->srcBuf || ms->lineno != 1)
+  {
+    scan(cx);
+    return;
+  }
+
+  /* cut after the first '\n' past each even share */
+  step = size / threads;
+  for (n = 0, i = 0; i < threads; i++)
+  {
+    const unsigned char *b = (n == 0) ? ms->pos : chunks[n - 1].end;
+    const unsigned char *e = ms->pos + (i + 1) * step;
+    if (i == threads - 1 || e >= ms->end)
+      e = ms->end;
+    else if (e < b)
+      continue;
+    else
+    {
+      e = (const unsigned char *)memchr(e, '\n', ms->end - e);
+      e = (e == NULL) ? ms->end : e + 1;
+    }
+    memset(&chunks[n], 0, sizeof(Chunk));
+    chunks[n].begin = b;
+    chunks[n].end = e;
+    chunks[n].cx = cx;
+    chunks[n].last = (e == ms->end);
+    n++;
+    if (e == ms->end)
       break;
+  }
+
+  pthread_once(&commentNextBuilt, buildCommentNext);
+  runChunks(chunks, n, summarizeChunk);
+  for (inComment = FALSE, line = 1, i = 0; i < n; i++)
+  {
+    chunks[i].inComment = inComment;
+    chunks[i].firstLine = line;
+    inComment = inComment ? chunks[i].exitIn : chunks[i].exitOut;
+    line += chunks[i].lines;
+  }
+  runChunks(chunks, n, scanChunk);
+
+  /* stitch the chunks together */
+  for (total = 0, i = 0; i < n; i++)
+    total += chunks[i].tokens.count;
+  while (tt->capacity < total)
+    growTokenTable(cx);
+  for (i = 0; i < n; i++)
+  {
+    TokenStore *ts = &chunks[i].tokens;
+    int at = (int)tt->count;
+    memcpy(tt->type + at, ts->type, ts->count * sizeof(TokenType));
+    memcpy(tt->lineno + at, ts->lineno, ts->count * sizeof(int));
+    memcpy(tt->offset + at, ts->offset, ts->count * sizeof(size_t));
+    memcpy(tt->len + at, ts->len, ts->count * sizeof(unsigned int));
+    memcpy(tt->attr + at, ts->attr, ts->count * sizeof(int));
+    tt->count += ts->count;
+    free(ts->type);
+    free(ts->lineno);
+    free(ts->offset);
+    free(ts->len);
+    free(ts->attr);
+  }
+  for (i = 0; i < tt->count; i++)
+    if (tt->type[i] == ID)
+      tt->attr[i] = internName(cx->symbols, sc->srcBuf + tt->offset[i], tt->len[i]);
+  ms->pos = ms->end;
+  ms->lineno = cx->lineno = line;
+}
+
+int verifyParallelScan(CompileContext *cx, int threads)
+{
+  TokenStore par;
+  TokenStore *tt = &cx->TokenTable;
+  int i, bad = 0;
+  scanParallel(cx, threads);
+  par = *tt;
+  memset(tt, 0, sizeof(TokenStore));
+  /* number the symbols afresh, as scan() would */
+  destroyInternTable(cx->symbols);
+  cx->lineno = 0;
+  startMainScan(cx);
+  scan(cx);
+  if (par.count != tt->count)
+  {
+    fprintf(stderr, "parallel scan: %lld tokens, sequential scan: %lld\n", par.count, tt->count);
+    bad++;
+  }
+  for (i = 0; i < par.count && i < tt->count; i++)
+    if (par.type[i] != tt->type[i] || par.lineno[i] != tt->lineno[i] ||
+        par.offset[i] != tt->offset[i] || par.len[i] != tt->len[i] ||
+        par.attr[i] != tt->attr[i])
+    {
+      if (bad++ < 10)
+        fprintf(stderr, "parallel scan differs at token %d (line %d)\n", i, tt->lineno[i]);
     }
+  free(par.type);
+  free(par.lineno);
+  free(par.offset);
+  free(par.len);
+  free(par.attr);
+  return bad;
+}
+
+/**************************************************/
+/*********   scan thread for --pipeline   **********/
+/**************************************************/
+/* The scan thread runs getToken and writes tokens
+   into the TokenTable ring; the parser thread reads
+   them. Both sides only exchange two counters, with
+   atomic loads and stores:
+     published - tokens the parser may read
+     released  - tokens below this one may be reused
+   The scan thread publishes every PIPEBATCH tokens,
+   the parser releases whenever it runs out. pipeLock
+   and pipeCond are used only to sleep when the ring
+   is full or empty. A full ring held back by a pin is
+   grown by the parser while the scan thread sleeps */
+
+/* PIPERING = initial capacity of the ring,
+   PIPEBATCH = tokens published at a time */
+#define PIPERING 4096
+#define PIPEBATCH 256
+
+/* BACKTRACK = tokens behind the current one the
+   parser may still go back to */
+#define BACKTRACK 2
+
+#define LOAD(v) __atomic_load_n(&(v), __ATOMIC_SEQ_CST)
+#define STORE(v, x) __atomic_store_n(&(v), (x), __ATOMIC_SEQ_CST)
+
+/* wakeUp wakes the other thread if it sleeps */
+static void wakeUp(Scanner *sc, int *waiting)
+{
+  if (LOAD(*waiting))
+  {
+    pthread_mutex_lock(&sc->pipeLock);
+    pthread_cond_broadcast(&sc->pipeCond);
+    pthread_mutex_unlock(&sc->pipeLock);
+  }
+}
 
-    if ((save) && (tokenStringIndex <= MAXTOKENLEN))
-      tokenString[tokenStringIndex++] = (char)c;
-    if (state == DONE)
+/* scanThreadMain is the body of the scan thread */
+static void *scanThreadMain(void *arg)
+{
+  CompileContext *cx = (CompileContext *)arg;
+  Scanner *sc = cx->scanner;
+  TokenType tok;
+  long long scanned = 0;
+  do
+  {
+    tok = getToken(cx);
+    if (scanned - LOAD(sc->released) == cx->TokenTable.capacity)
+    { /* ring full: hand over what we have and sleep */
+      STORE(sc->published, scanned);
+      wakeUp(sc, &sc->parserWaiting);
+      pthread_mutex_lock(&sc->pipeLock);
+      STORE(sc->scannerWaiting, TRUE);
+      pthread_cond_broadcast(&sc->pipeCond);
+      while (!LOAD(sc->stopScanning) && scanned - LOAD(sc->released) == cx->TokenTable.capacity)
+        pthread_cond_wait(&sc->pipeCond, &sc->pipeLock);
+      STORE(sc->scannerWaiting, FALSE);
+      pthread_mutex_unlock(&sc->pipeLock);
+      if (LOAD(sc->stopScanning))
+        break;
+    }
+    storeToken(cx, scanned++, tok);
+    if (tok == ENDFILE || scanned - sc->published >= PIPEBATCH)
     {
-      tokenString[tokenStringIndex] = '\0';
-      if (currentToken == ID)
-        // 查看是否为保留字
-        currentToken = reservedLookup(tokenString);
+      STORE(sc->published, scanned);
+      wakeUp(sc, &sc->parserWaiting);
     }
+  } while (tok != ENDFILE);
+  return arg;
+}
+
+/* waitForTokens is getNextToken for the parser
+   thread: it releases the tokens the parser is done
+   with and waits until more are published */
+static void waitForTokens(CompileContext *cx)
+{
+  Scanner *sc = cx->scanner;
+  TokenStore *tt = &cx->TokenTable;
+  long long keep = tt->count - BACKTRACK;
+  long long n;
+  if (keep > sc->tokenPin)
+    keep = sc->tokenPin;
+  if (keep > tt->first)
+  {
+    tt->first = keep;
+    STORE(sc->released, keep);
+    wakeUp(sc, &sc->scannerWaiting);
   }
-  if (TraceScan)
+  while ((n = LOAD(sc->published)) <= tt->count)
   {
-    fprintf(listing, "\t%d: ", lineno);
-    printToken(currentToken, tokenString);
+    pthread_mutex_lock(&sc->pipeLock);
+    STORE(sc->parserWaiting, TRUE);
+    while ((n = LOAD(sc->published)) <= tt->count)
+    {
+      if (LOAD(sc->scannerWaiting) && n - tt->first == tt->capacity)
+      { /* the ring is full of pinned tokens */
+        growTokenTable(cx);
+        pthread_cond_broadcast(&sc->pipeCond);
+      }
+      pthread_cond_wait(&sc->pipeCond, &sc->pipeLock);
+    }
+    STORE(sc->parserWaiting, FALSE);
+    pthread_mutex_unlock(&sc->pipeLock);
   }
-  return currentToken;
-} /* end getToken */
+  tt->count = n;
+}
+
+void startScanThread(CompileContext *cx)
+{
+  Scanner *sc;
+  if (cx->scanner == NULL || cx->scanner->mainScan.pos == NULL)
+    loadSource(cx);
+  sc = cx->scanner;
+  sc->streaming = TRUE;
+  while (cx->TokenTable.capacity < PIPERING)
+    growTokenTable(cx);
+  sc->published = sc->released = 0;
+  sc->stopScanning = FALSE;
+  sc->pipelined = TRUE;
+  if (pthread_create(&sc->scanThread, NULL, scanThreadMain, cx) != 0)
+  {
+    fprintf(stderr, "unable to start the scan thread\n");
+    exit(1);
+  }
+}
+
+void stopScanThread(CompileContext *cx)
+{
+  Scanner *sc = cx->scanner;
+  if (sc == NULL || !sc->pipelined)
+    return;
+  STORE(sc->stopScanning, TRUE);
+  pthread_mutex_lock(&sc->pipeLock);
+  pthread_cond_broadcast(&sc->pipeCond);
+  pthread_mutex_unlock(&sc->pipeLock);
+  pthread_join(sc->scanThread, NULL);
+  sc->pipelined = FALSE;
+}
+
+#ifndef _WIN32
+/* dropScanned gives back the pages of a mapped source
+   that lie before the oldest token still held, once
+   DROPBYTES of them have piled up, so streaming a
+   file keeps only a window of it in memory. They are
+   read in again should anything look back at them */
+static void dropScanned(CompileContext *cx)
+{
+  Scanner *sc = cx->scanner;
+  TokenStore *ts = &cx->TokenTable;
+  size_t keep = ts->offset[TOKENSLOT(cx, ts->first)];
+  if (keep < sc->srcDropped + DROPBYTES)
+    return;
+  keep -= keep % (size_t)sysconf(_SC_PAGESIZE);
+  madvise(sc->srcBuf + sc->srcDropped, keep - sc->srcDropped, MADV_DONTNEED);
+  sc->srcDropped = keep;
+}
+#endif
+
+void skipNames(CompileContext *cx)
+{
+  Scanner *sc = scannerOf(cx);
+  sc->noNames = TRUE;
+  sc->mainScan.symbols = NULL;
+}
 
-void scan(void)
+/* getNextToken scans one more token into TokenTable
+   on demand. Called on an empty TokenTable it turns
+   the table into a ring of the most recent tokens.
+   Unless tokens or lines are being listed, which
+   must keep in step with the parser's errors, it
+   scans up to STREAMBATCH tokens ahead at once */
+TokenType getNextToken(CompileContext *cx)
 {
   TokenType tok;
-  tok = getToken();
-  TokenNode *t = malloc(sizeof(TokenNode));
-  TokenTable = t;
-  t->lineno = -1;
-  t->tokenString = "";
-  t->type = -1;
-  t->next = NULL;
-  TokenTable->pre = NULL;
-  while (tok != ENDFILE)
-  {
-    char *tokstr = (char *)malloc(sizeof(char) * (MAXTOKENLEN + 1));
-    TokenNode *tn = malloc(sizeof(TokenNode));
-    tn->type = tok;
-    strcpy(tokstr, tokenString);
-    tn->tokenString = tokstr;
-    tn->lineno = lineno;
-    tn->next = NULL;
-    t->next = tn;
-    tn->pre = t;
-    t = tn;
-    tok = getToken();
-  }
-  char *tokstr = (char *)malloc(sizeof(char) * (MAXTOKENLEN + 1));
-  TokenNode *tn = malloc(sizeof(TokenNode));
-  tn->type = tok;
-  strcpy(tokstr, tokenString);
-  tn->tokenString = tokstr;
-  tn->lineno = lineno;
-  tn->next = NULL;
-  t->next = tn;
-  tn->pre = t;
-  t = tn;
-}
-
-void destroyTokenTable()
-{
-  TokenNode *t1 = TokenTable;
-  TokenNode *t2 = TokenTable->next;
-  while (t2 != NULL)
-  {
-    free(t1);
-    t1 = t2;
-    t2 = t2->next;
-  }
-  free(t1);
-}
\ No newline at end of file
+  Scanner *sc = scannerOf(cx);
+  ScanState *st = &sc->mainScan;
+  TokenStore *ts = &cx->TokenTable;
+  int i;
+  if (sc->pipelined)
+  {
+    waitForTokens(cx);
+    return TOKENTYPE(cx, cx->TokenTable.count - 1);
+  }
+  if (cx->TokenTable.count == 0)
+    sc->streaming = TRUE;
+  tok = getToken(cx);
+  appendToken(cx, tok);
+  if (!TraceScan && !st->echo)
+  {
+    /* room is made for the whole batch at once, by
+       dropping the oldest tokens not pinned */
+    long long drop = ts->count + STREAMBATCH - 1 - ts->first - ts->capacity;
+    if (drop > sc->tokenPin - ts->first)
+      drop = sc->tokenPin - ts->first;
+    if (drop > 0)
+      ts->first += drop;
+    for (i = 1; i < STREAMBATCH && tok != ENDFILE && ts->count - ts->first < ts->capacity; i++)
+    {
+      tok = lexToken(st);
+      putToken(ts, TOKENSLOT(cx, ts->count), st, tok);
+      ts->count++;
+    }
+    cx->lineno = st->lineno;
+  }
+#ifndef _WIN32
+  if (sc->srcMapped && cx->TokenTable.first > 0)
+    dropScanned(cx);
+#endif
+  return tok;
+}
+
+long long pinTokens(CompileContext *cx, long long i)
+{
+  Scanner *sc = scannerOf(cx);
+  long long previous = sc->tokenPin;
+  if (i < sc->tokenPin)
+    sc->tokenPin = i;
+  return previous;
+}
+
+void unpinTokens(CompileContext *cx, long long previous)
+{
+  scannerOf(cx)->tokenPin = previous;
+}
+
+/* tokenText returns the lexeme of token i; it is
+   TokenTable.len[TOKENSLOT(i)] characters long and
+   is not NUL-terminated */
+const char *tokenText(const CompileContext *cx, long long i)
+{
+  return cx->scanner->srcBuf + cx->TokenTable.offset[TOKENSLOT(cx, i)];
+}
+
+/* copyTokenString copies the lexeme of token i,
+   NUL-terminated and cut to fit, into buf */
+void copyTokenString(const CompileContext *cx, long long i, char *buf, int size)
+{
+  unsigned int n = cx->TokenTable.len[TOKENSLOT(cx, i)];
+  if (n > (unsigned int)size - 1)
+    n = size - 1;
+  memcpy(buf, tokenText(cx, i), n);
+  buf[n] = '\0';
+}
+
+void clearTokenTable(CompileContext *cx)
+{
+  cx->TokenTable.count = cx->TokenTable.first = 0;
+  if (cx->scanner != NULL)
+  {
+    cx->scanner->streaming = FALSE;
+    cx->scanner->tokenPin = LLONG_MAX;
+  }
+}
+
+/**************************************************/
+/***********   re-lexing an edit        ************/
+/**************************************************/
+
+/* editSource replaces characters start up to end of
+   the source with the n characters of text, first
+   moving the source into a buffer of its own */
+static void editSource(Scanner *sc, size_t start, size_t end, const char *text, size_t n)
+{
+  size_t size = sc->srcSize - (end - start) + n;
+  if (sc->srcMapped || sc->srcBorrowed || sc->srcCapacity < size)
+  {
+    size_t cap = 2 * size + READCHUNK;
+    char *buf = (char *)malloc(cap);
+    if (buf == NULL)
+    {
+      fprintf(stderr, "Out of memory error editing the source\n");
+      exit(1);
+    }
+    memcpy(buf, sc->srcBuf, sc->srcSize);
+#ifndef _WIN32
+    if (sc->srcMapped)
+      munmap(sc->srcBuf, sc->srcSize);
+    else
+#endif
+      if (!sc->srcBorrowed)
+        free(sc->srcBuf);
+    sc->srcBuf = buf;
+    sc->srcCapacity = cap;
+    sc->srcMapped = sc->srcBorrowed = FALSE;
+  }
+  memmove(sc->srcBuf + start + n, sc->srcBuf + end, sc->srcSize - end);
+  memcpy(sc->srcBuf + start, text, n);
+  sc->srcSize = size;
+  sc->srcEnd = sc->srcBuf + size;
+  /* getToken has nothing more to scan */
+  sc->mainScan.pos = sc->mainScan.end = (const unsigned char *)sc->srcEnd;
+}
+
+/* SPLICE moves the tokens from old on of array a to
+   start at new instead */
+#define SPLICE(a, old, new, count) memmove((a) + (new), (a) + (old), ((count) - (old)) * sizeof(*(a)))
+
+void relexEdit(CompileContext *cx, size_t start, size_t end, const char *text, size_t n, TokenEdit *te)
+{
+  Scanner *sc = cx->scanner;
+  TokenStore *tt = &cx->TokenTable;
+  TokenStore fresh;
+  ScanState st;
+  long delta = (long)n - (long)(end - start);
+  int count = (int)tt->count, lineDelta = 0;
+  int lo, hi, k, j, sync, i, last;
+
+  /* k is the last token ending before the edit: the
+     lexer starts afresh right after it. j is the
+     first token past the edit, the first the new
+     stream can fall in step with again */
+  for (lo = 0, hi = count; lo < hi;)
+  {
+    int mid = (lo + hi) / 2;
+    if (tt->offset[mid] + tt->len[mid] < start)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  k = lo - 1;
+  for (lo = k + 1, hi = count; lo < hi;)
+  {
+    int mid = (lo + hi) / 2;
+    if (tt->offset[mid] < end)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  j = lo;
+
+  editSource(sc, start, end, text, n);
+  memset(&st, 0, sizeof(st));
+  st.pos = (const unsigned char *)sc->srcBuf + (k >= 0 ? tt->offset[k] + tt->len[k] : 0);
+  st.end = (const unsigned char *)sc->srcEnd;
+  st.lineno = (k >= 0) ? tt->lineno[k] : 1;
+  st.symbols = cx->symbols;
+  st.kernels = kernels;
+  st.cx = cx;
+
+  /* lex until a token past the new text starts where
+     an old one did, shifted by delta, and is the same
+     token: from there on the streams agree */
+  memset(&fresh, 0, sizeof(fresh));
+  sync = count;
+  for (;;)
+  {
+    TokenType tok = lexToken(&st);
+    size_t b = st.tokenBegin - sc->srcBuf;
+    if (b >= start + n)
+    {
+      size_t o = b - delta;
+      while (j < count && tt->offset[j] < o)
+        j++;
+      for (i = j; i < count && tt->offset[i] == o; i++)
+        if (tt->type[i] == tok && tt->len[i] == (unsigned int)(st.tokenEnd - st.tokenBegin))
+          break;
+      if (i < count && tt->offset[i] == o)
+      {
+        sync = i;
+        lineDelta = st.lineno - tt->lineno[i];
+        break;
+      }
+    }
+    addToken(&fresh, &st, tok);
+    if (tok == ENDFILE)
+      break;
+  }
+
+  /* the old tokens k+1 up to sync give way to the
+     fresh ones, and those after them move along */
+  last = k + 1 + fresh.count;
+  tt->count = count - (sync - (k + 1)) + fresh.count;
+  while (tt->capacity < tt->count)
+    growTokenTable(cx);
+  if (last != sync)
+  {
+    SPLICE(tt->type, sync, last, count);
+    SPLICE(tt->lineno, sync, last, count);
+    SPLICE(tt->offset, sync, last, count);
+    SPLICE(tt->len, sync, last, count);
+    SPLICE(tt->attr, sync, last, count);
+  }
+  if (delta != 0)
+    addToOffsets(tt->offset + last, tt->count - last, delta);
+  if (lineDelta != 0)
+    addToRun((unsigned int *)tt->lineno + last, tt->count - last, lineDelta);
+  if (fresh.count > 0)
+  {
+    memcpy(tt->type + k + 1, fresh.type, fresh.count * sizeof(TokenType));
+    memcpy(tt->lineno + k + 1, fresh.lineno, fresh.count * sizeof(int));
+    memcpy(tt->offset + k + 1, fresh.offset, fresh.count * sizeof(size_t));
+    memcpy(tt->len + k + 1, fresh.len, fresh.count * sizeof(unsigned int));
+    memcpy(tt->attr + k + 1, fresh.attr, fresh.count * sizeof(int));
+  }
+  free(fresh.type);
+  free(fresh.lineno);
+  free(fresh.offset);
+  free(fresh.len);
+  free(fresh.attr);
+
+  te->first = k + 1;
+  te->oldEnd = sync;
+  te->newEnd = last;
+  te->lineDelta = lineDelta;
+}
+
+void destroyTokenTable(CompileContext *cx)
+{
+  TokenStore *tt = &cx->TokenTable;
+  free(tt->type);
+  free(tt->lineno);
+  free(tt->offset);
+  free(tt->len);
+  free(tt->attr);
+  memset(tt, 0, sizeof(TokenStore));
+  if (cx->scanner != NULL)
+  {
+    cx->scanner->streaming = FALSE;
+    cx->scanner->tokenPin = LLONG_MAX;
+  }
+}
@@ -9,20 +9,126 @@
 #define _SCAN_H_
 #include "globals.h"
 
-/* MAXTOKENLEN is the maximum size of a token */
+/* every function below works on the TokenTable and
+ * scanner of the context cx it is given; contexts
+ * may be used on different threads at once
+ */
 
-/* tokenString array stores the lexeme of each token */
-extern char tokenString[MAXTOKENLEN + 1];
+/* ScanKernelLevel is the highest KERNEL_ level
+ * (simdscan.h) getToken may use; the best one the
+ * CPU supports is chosen when the first source is
+ * loaded
+ */
+extern int ScanKernelLevel;
 
 // 扫描源文件生成符号表
-void scan(void);
+void scan(CompileContext *cx);
+
+/* function scanParallel fills TokenTable like scan(),
+ * lexing chunks of the file on up to threads threads
+ * (one per CPU if threads is 0); small files, and
+ * the EchoSource and TraceScan listings, are scanned
+ * sequentially
+ */
+void scanParallel(CompileContext *cx, int threads);
+
+/* function verifyParallelScan runs scanParallel, then
+ * scan() over again, and returns the number of tokens
+ * that differ; TokenTable is left as scan() made it
+ */
+int verifyParallelScan(CompileContext *cx, int threads);
 
 /* function getToken returns the 
  * next token in source file
  */
 
-TokenType getToken(void);
+TokenType getToken(CompileContext *cx);
+
+/* function getNextToken scans at least one more
+ * token into TokenTable and returns the type of the
+ * last. Used instead of scan(), it keeps TokenTable a
+ * small ring of recent tokens so memory does not grow
+ * with the source
+ */
+TokenType getNextToken(CompileContext *cx);
+
+/* skipNames makes getToken leave identifiers
+ * uninterned, their attr NOSYMBOL, for a parse that
+ * only needs the token types
+ */
+void skipNames(CompileContext *cx);
+
+/* startScanThread runs the scanner on a thread of its
+ * own; getNextToken then waits for the tokens it
+ * produces instead of scanning them itself.
+ * stopScanThread stops and joins that thread
+ */
+void startScanThread(CompileContext *cx);
+void stopScanThread(CompileContext *cx);
+
+/* function pinTokens keeps token i and every later
+ * token in TokenTable until unpinTokens is called
+ * with the value pinTokens returned; pins nest
+ */
+long long pinTokens(CompileContext *cx, long long i);
+void unpinTokens(CompileContext *cx, long long previous);
+
+/* useSourceBuffer makes the size characters of text,
+ * which need not be NUL-terminated, the source of cx
+ * instead of cx->source. Tokens point into text, so
+ * it must outlive cx; nothing is copied
+ */
+void useSourceBuffer(CompileContext *cx, const char *text, size_t size);
+
+/* function sourceText returns the whole source text
+ * of cx, size characters long, which the offsets of
+ * TokenTable refer to
+ */
+const char *sourceText(CompileContext *cx, size_t *size);
+
+/* TokenEdit is what relexEdit did to TokenTable: the
+ * tokens first up to oldEnd were replaced by those
+ * first up to newEnd, and the ones after moved along
+ * with their lines lineDelta further on
+ */
+typedef struct tokenEdit
+{
+  int first, oldEnd, newEnd;
+  int lineDelta;
+} TokenEdit;
+
+/* relexEdit replaces characters start up to end of
+ * the source of cx with the n characters of text and
+ * updates TokenTable, which scan() must have filled,
+ * lexing only from the last token before the edit
+ * until the tokens fall in step with the old ones
+ */
+void relexEdit(CompileContext *cx, size_t start, size_t end, const char *text, size_t n, TokenEdit *te);
 
-TokenNode *getNextToken(void);
+/* function tokenText returns the lexeme of token i
+ * in TokenTable; it is TokenTable.len[TOKENSLOT(i)]
+ * characters long and is not NUL-terminated
+ */
+const char *tokenText(const CompileContext *cx, long long i);
+
+/* function copyTokenString copies the lexeme of
+ * token i into buf, which holds size characters;
+ * it is NUL-terminated and cut short to fit
+ */
+void copyTokenString(const CompileContext *cx, long long i, char *buf, int size);
+
+// 释放 scan 生成的符号表
+void destroyTokenTable(CompileContext *cx);
+
+/* clearTokenTable empties TokenTable but keeps
+ * its arrays for the next file's tokens
+ */
+void clearTokenTable(CompileContext *cx);
+
+/* releaseSource unmaps or frees the source
+ * buffer the scanner reads from, stopping the scan
+ * thread if there is one
+ */
+void releaseSource(CompileContext *cx);
 
 #endif
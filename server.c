@@ -0,0 +1,215 @@
+/****************************************************/
+/* File: server.c                                   */
+/* The --server mode of the C- compiler: one        */
+/* process answering parse requests on stdin        */
+/****************************************************/
+
+#include "server.h"
+#include "util.h"
+#include "scan.h"
+#include "parse.h"
+#include "incr.h"
+
+/* HEADERLEN = longest header line accepted */
+#define HEADERLEN 64
+
+/* Request is the request being answered; body
+   (the path or the source) is kept from one
+   request to the next and only ever grows */
+typedef struct request
+{
+  char kind[8];
+  int tree;
+  size_t size;
+  char *body;
+  size_t capacity;
+} Request;
+
+/* readRequest reads the next request into rq;
+   it returns FALSE at the end of in, and also,
+   with rq->kind empty, for a malformed one */
+static int readRequest(FILE *in, Request *rq)
+{
+  char header[HEADERLEN];
+  rq->kind[0] = '\0';
+  if (fgets(header, sizeof(header), in) == NULL)
+    return FALSE;
+  if (sscanf(header, "%7s %d %zu", rq->kind, &rq->tree, &rq->size) != 3)
+  {
+    rq->kind[0] = '\0';
+    return FALSE;
+  }
+  if (rq->size + 1 > rq->capacity)
+  {
+    char *body = (char *)realloc(rq->body, rq->size + 1);
+    if (body == NULL)
+    {
+      fprintf(stderr, "Out of memory reading a request\n");
+      exit(1);
+    }
+    rq->body = body;
+    rq->capacity = rq->size + 1;
+  }
+  if (fread(rq->body, 1, rq->size, in) != rq->size)
+  {
+    rq->kind[0] = '\0';
+    return FALSE;
+  }
+  rq->body[rq->size] = '\0';
+  return TRUE;
+}
+
+/* Session is what the server keeps from one request
+   to the next: the context, and the parse of the last
+   source for edits to be made to */
+typedef struct session
+{
+  CompileContext *cx;
+  IncrementalParse ip;
+  int editing; /* TRUE while ip holds a parse */
+  char *text;  /* the source of a text request */
+} Session;
+
+/* endEditing drops the last source: it goes before
+   the next request, the memory of the context does
+   not */
+static void endEditing(Session *ss)
+{
+  if (ss->editing)
+    endIncremental(&ss->ip);
+  ss->editing = FALSE;
+  resetCompileContext(ss->cx, NULL, NULL);
+  free(ss->text);
+  ss->text = NULL;
+}
+
+/* edit applies the edit request rq to the source
+   last parsed; FALSE, with the reason in listing,
+   if it cannot */
+static int edit(Session *ss, Request *rq, FILE *listing)
+{
+  size_t start, end, size;
+  char *text = memchr(rq->body, '\n', rq->size);
+  if (!ss->editing)
+  {
+    fprintf(listing, "Nothing to edit\n");
+    return FALSE;
+  }
+  sourceText(ss->cx, &size);
+  if (text == NULL || sscanf(rq->body, "%zu %zu", &start, &end) != 2 ||
+      start > end || end > size)
+  {
+    fprintf(listing, "Bad edit\n");
+    return FALSE;
+  }
+  text++;
+  editIncremental(&ss->ip, start, end, text, rq->size - (text - rq->body));
+  return TRUE;
+}
+
+/* answer compiles the source of rq in the context of
+   ss with the listing going to listing; it returns
+   the number of syntax errors, -1 if there was
+   nothing to compile */
+static int answer(Session *ss, Request *rq, FILE *listing)
+{
+  CompileContext *cx = ss->cx;
+  FILE *source;
+  size_t size;
+  int errors;
+  if (strcmp(rq->kind, "edit") == 0)
+  {
+    if (!edit(ss, rq, listing))
+      return -1;
+    cx->listing = listing;
+  }
+  else if (strcmp(rq->kind, "file") == 0)
+  {
+    endEditing(ss);
+    source = fopen(rq->body, "r");
+    if (source == NULL)
+    {
+      fprintf(listing, "File %s not found\n", rq->body);
+      return -1;
+    }
+    /* the file is read in now, to be closed */
+    resetCompileContext(cx, source, listing);
+    sourceText(cx, &size);
+    fclose(source);
+    cx->source = NULL;
+  }
+  else if (strcmp(rq->kind, "text") == 0)
+  {
+    endEditing(ss);
+    /* the source is kept for edits, so the next
+       request is read into a buffer of its own */
+    ss->text = rq->body;
+    rq->body = NULL;
+    rq->capacity = 0;
+    resetCompileContext(cx, NULL, listing);
+    useSourceBuffer(cx, ss->text, rq->size);
+  }
+  else
+  {
+    fprintf(listing, "Unknown request %s\n", rq->kind);
+    return -1;
+  }
+  if (!ss->editing)
+    startIncremental(&ss->ip, cx);
+  ss->editing = TRUE;
+  /* with syntax errors the tree is recovered by
+     parse(), which reports them */
+  if (ss->ip.holes > 0)
+    incrementalTree(&ss->ip);
+  if (rq->tree)
+  {
+    fprintf(listing, "\nSyntax tree:\n");
+    printTree(cx, incrementalTree(&ss->ip));
+  }
+  errors = cx->errorCount;
+  cx->listing = NULL;
+  return errors;
+}
+
+int serveRequests(FILE *in, FILE *out)
+{
+  Session ss;
+  Request rq;
+  char *text;
+  size_t size;
+  FILE *listing;
+  int errors;
+  memset(&ss, 0, sizeof(ss));
+  ss.cx = newCompileContext(NULL, NULL);
+  if (ss.cx == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  memset(&rq, 0, sizeof(rq));
+  while (readRequest(in, &rq))
+  {
+    text = NULL;
+    listing = open_memstream(&text, &size);
+    if (listing == NULL)
+    {
+      fprintf(stderr, "Out of memory answering a request\n");
+      exit(1);
+    }
+    errors = answer(&ss, &rq, listing);
+    fclose(listing);
+    fprintf(out, "%d %zu\n", errors, size);
+    fwrite(text, 1, size, out);
+    fflush(out);
+    free(text);
+  }
+  endEditing(&ss);
+  freeCompileContext(ss.cx);
+  free(rq.body);
+  if (rq.kind[0] == '\0' && !feof(in))
+  {
+    fprintf(stderr, "Malformed request\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,43 @@
+/****************************************************/
+/* File: server.h                                   */
+/* The --server mode of the C- compiler: one        */
+/* process answering parse requests on stdin        */
+/****************************************************/
+
+#ifndef _SERVER_H_
+#define _SERVER_H_
+#include "globals.h"
+
+/* A request is a header line and n bytes:
+ *
+ *   file T n\n  path       parse the file path
+ *   text T n\n  source     parse the n bytes given
+ *   edit T n\n  s e\n text  replace characters s up
+ *                          to e of the source last
+ *                          parsed with text, the rest
+ *                          of the n bytes, and parse
+ *                          it again
+ *
+ * where T is 1 to have the syntax tree printed and 0
+ * not. The answer is also a header line and n bytes:
+ *
+ *   E n\n  listing
+ *
+ * E being the number of syntax errors, -1 if the file
+ * could not be read or the request was not understood,
+ * and the listing what the compiler would write to
+ * result.txt after its first line: the errors and, if
+ * asked for, the tree. An edit is parsed
+ * incrementally (see incr.h): only the declarations
+ * it touches are parsed again, and its listing never
+ * echoes the source or lists the tokens
+ */
+
+/* Function serveRequests answers the requests read
+ * from in on out until in ends, compiling them all
+ * in one CompileContext; it returns 0, or 1 if in
+ * held something that is not a request
+ */
+int serveRequests(FILE *in, FILE *out);
+
+#endif
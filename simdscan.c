@@ -0,0 +1,298 @@
+/****************************************************/
+/* File: simdscan.c                                 */
+/* Vectorized scanning kernels for the C- scanner   */
+/* SSE2 and AVX2 versions are compiled with target  */
+/* attributes and chosen at run time from CPUID;    */
+/* scalar tails finish the last partial block       */
+/****************************************************/
+
+#include "simdscan.h"
+#include <stddef.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_KERNELS 0
+#endif
+
+/* the character sets below must agree with tokens.def;
+   scan.c checks that before using these kernels */
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+#define IS_LETTER(c) ((unsigned char)(((c) | 0x20) - 'a') < 26)
+#define IS_DIGIT(c) ((unsigned char)((c) - '0') < 10)
+
+/**************************************************/
+/***********   scalar tails             ************/
+/**************************************************/
+
+static const unsigned char *skipSpaceScalar(const unsigned char *p, const unsigned char *end, int *lines)
+{
+  int n = 0;
+  while (p < end && IS_SPACE(*p))
+    n += (*p++ == '\n');
+  *lines = n;
+  return p;
+}
+
+static const unsigned char *commentEndScalar(const unsigned char *p, const unsigned char *end, int *lines)
+{
+  int n = 0;
+  while (p < end && !(p[0] == '*' && p + 1 < end && p[1] == '/'))
+    n += (*p++ == '\n');
+  *lines = n;
+  return p;
+}
+
+static const unsigned char *letterRunScalar(const unsigned char *p, const unsigned char *end)
+{
+  while (p < end && IS_LETTER(*p))
+    p++;
+  return p;
+}
+
+static const unsigned char *digitRunScalar(const unsigned char *p, const unsigned char *end)
+{
+  while (p < end && IS_DIGIT(*p))
+    p++;
+  return p;
+}
+
+#if HAVE_X86_KERNELS
+
+/* COUNT_BELOW counts the '\n' bits of mask below bit k */
+#define COUNT_BELOW(mask, k) __builtin_popcount((mask) & ((1u << (k)) - 1))
+
+/**************************************************/
+/***********   SSE2 kernels, 16 bytes   ************/
+/**************************************************/
+
+__attribute__((target("sse2"))) static const unsigned char *
+skipSpaceSSE2(const unsigned char *p, const unsigned char *end, int *lines)
+{
+  const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+  const __m128i nl = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+  int n = 0, rest;
+  while (end - p >= 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i isnl = _mm_cmpeq_epi8(v, nl);
+    __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+                              _mm_or_si128(isnl, _mm_cmpeq_epi8(v, cr)));
+    unsigned int other = ~(unsigned int)_mm_movemask_epi8(ws) & 0xFFFF;
+    unsigned int nlmask = (unsigned int)_mm_movemask_epi8(isnl);
+    if (other)
+    {
+      int k = __builtin_ctz(other);
+      *lines = n + COUNT_BELOW(nlmask, k);
+      return p + k;
+    }
+    n += __builtin_popcount(nlmask);
+    p += 16;
+  }
+  p = skipSpaceScalar(p, end, &rest);
+  *lines = n + rest;
+  return p;
+}
+
+__attribute__((target("sse2"))) static const unsigned char *
+commentEndSSE2(const unsigned char *p, const unsigned char *end, int *lines)
+{
+  const __m128i star = _mm_set1_epi8('*'), slash = _mm_set1_epi8('/');
+  const __m128i nl = _mm_set1_epi8('\n');
+  int n = 0, rest;
+  while (end - p >= 17)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i w = _mm_loadu_si128((const __m128i *)(p + 1));
+    unsigned int hit = (unsigned int)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(v, star), _mm_cmpeq_epi8(w, slash)));
+    unsigned int nlmask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+    if (hit)
+    {
+      int k = __builtin_ctz(hit);
+      *lines = n + COUNT_BELOW(nlmask, k);
+      return p + k;
+    }
+    n += __builtin_popcount(nlmask);
+    p += 16;
+  }
+  p = commentEndScalar(p, end, &rest);
+  *lines = n + rest;
+  return p;
+}
+
+/* IN_RANGE_SSE2 marks the bytes of v with v - lo < count */
+#define IN_RANGE_SSE2(v, lo, count)                                           \
+  _mm_cmpeq_epi8(_mm_max_epu8(_mm_sub_epi8((v), _mm_set1_epi8(lo)),          \
+                              _mm_set1_epi8((count)-1)),                     \
+                 _mm_set1_epi8((count)-1))
+
+__attribute__((target("sse2"))) static const unsigned char *
+letterRunSSE2(const unsigned char *p, const unsigned char *end)
+{
+  const __m128i lower = _mm_set1_epi8(0x20);
+  while (end - p >= 16)
+  {
+    __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i *)p), lower);
+    unsigned int other = ~(unsigned int)_mm_movemask_epi8(IN_RANGE_SSE2(v, 'a', 26)) & 0xFFFF;
+    if (other)
+      return p + __builtin_ctz(other);
+    p += 16;
+  }
+  return letterRunScalar(p, end);
+}
+
+__attribute__((target("sse2"))) static const unsigned char *
+digitRunSSE2(const unsigned char *p, const unsigned char *end)
+{
+  while (end - p >= 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    unsigned int other = ~(unsigned int)_mm_movemask_epi8(IN_RANGE_SSE2(v, '0', 10)) & 0xFFFF;
+    if (other)
+      return p + __builtin_ctz(other);
+    p += 16;
+  }
+  return digitRunScalar(p, end);
+}
+
+static const ScanKernels sse2Kernels = {
+    skipSpaceSSE2, commentEndSSE2, letterRunSSE2, digitRunSSE2, KERNEL_SSE2};
+
+/**************************************************/
+/***********   AVX2 kernels, 32 bytes   ************/
+/**************************************************/
+
+__attribute__((target("avx2"))) static const unsigned char *
+skipSpaceAVX2(const unsigned char *p, const unsigned char *end, int *lines)
+{
+  const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+  const __m256i nl = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+  int n = 0, rest;
+  while (end - p >= 32)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i isnl = _mm256_cmpeq_epi8(v, nl);
+    __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+                                 _mm256_or_si256(isnl, _mm256_cmpeq_epi8(v, cr)));
+    unsigned int other = ~(unsigned int)_mm256_movemask_epi8(ws);
+    unsigned int nlmask = (unsigned int)_mm256_movemask_epi8(isnl);
+    if (other)
+    {
+      int k = __builtin_ctz(other);
+      *lines = n + COUNT_BELOW(nlmask, k);
+      return p + k;
+    }
+    n += __builtin_popcount(nlmask);
+    p += 32;
+  }
+  p = skipSpaceSSE2(p, end, &rest);
+  *lines = n + rest;
+  return p;
+}
+
+__attribute__((target("avx2"))) static const unsigned char *
+commentEndAVX2(const unsigned char *p, const unsigned char *end, int *lines)
+{
+  const __m256i star = _mm256_set1_epi8('*'), slash = _mm256_set1_epi8('/');
+  const __m256i nl = _mm256_set1_epi8('\n');
+  int n = 0, rest;
+  while (end - p >= 33)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i w = _mm256_loadu_si256((const __m256i *)(p + 1));
+    unsigned int hit = (unsigned int)_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(v, star), _mm256_cmpeq_epi8(w, slash)));
+    unsigned int nlmask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+    if (hit)
+    {
+      int k = __builtin_ctz(hit);
+      *lines = n + COUNT_BELOW(nlmask, k);
+      return p + k;
+    }
+    n += __builtin_popcount(nlmask);
+    p += 32;
+  }
+  p = commentEndSSE2(p, end, &rest);
+  *lines = n + rest;
+  return p;
+}
+
+#define IN_RANGE_AVX2(v, lo, count)                                              \
+  _mm256_cmpeq_epi8(_mm256_max_epu8(_mm256_sub_epi8((v), _mm256_set1_epi8(lo)), \
+                                    _mm256_set1_epi8((count)-1)),               \
+                    _mm256_set1_epi8((count)-1))
+
+__attribute__((target("avx2"))) static const unsigned char *
+letterRunAVX2(const unsigned char *p, const unsigned char *end)
+{
+  const __m256i lower = _mm256_set1_epi8(0x20);
+  while (end - p >= 32)
+  {
+    __m256i v = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)p), lower);
+    unsigned int other = ~(unsigned int)_mm256_movemask_epi8(IN_RANGE_AVX2(v, 'a', 26));
+    if (other)
+      return p + __builtin_ctz(other);
+    p += 32;
+  }
+  return letterRunSSE2(p, end);
+}
+
+__attribute__((target("avx2"))) static const unsigned char *
+digitRunAVX2(const unsigned char *p, const unsigned char *end)
+{
+  while (end - p >= 32)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    unsigned int other = ~(unsigned int)_mm256_movemask_epi8(IN_RANGE_AVX2(v, '0', 10));
+    if (other)
+      return p + __builtin_ctz(other);
+    p += 32;
+  }
+  return digitRunSSE2(p, end);
+}
+
+static const ScanKernels avx2Kernels = {
+    skipSpaceAVX2, commentEndAVX2, letterRunAVX2, digitRunAVX2, KERNEL_AVX2};
+
+#endif /* HAVE_X86_KERNELS */
+
+const ScanKernels *selectScanKernels(int maxLevel)
+{
+#if HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if (maxLevel >= KERNEL_AVX2 && __builtin_cpu_supports("avx2"))
+    return &avx2Kernels;
+  if (maxLevel >= KERNEL_SSE2 && __builtin_cpu_supports("sse2"))
+    return &sse2Kernels;
+#endif
+  return NULL;
+}
+
+int kernelCharClass(int c)
+{
+  if (IS_SPACE(c))
+    return KERNEL_CC_SPACE;
+  if (IS_LETTER(c))
+    return KERNEL_CC_LETTER;
+  if (IS_DIGIT(c))
+    return KERNEL_CC_DIGIT;
+  return KERNEL_CC_OTHER;
+}
+
+/* a plain loop, but built with kernelflags the
+   compiler vectorizes it */
+void addToRun(unsigned int *a, int n, int d)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    a[i] += d;
+}
+
+void addToOffsets(size_t *a, int n, long d)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    a[i] += d;
+}
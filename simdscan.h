@@ -0,0 +1,62 @@
+/****************************************************/
+/* File: simdscan.h                                 */
+/* Vectorized scanning kernels for the C- scanner   */
+/****************************************************/
+
+#ifndef _SIMDSCAN_H_
+#define _SIMDSCAN_H_
+#include <stddef.h>
+
+/* kernel levels, in increasing order of preference */
+#define KERNEL_SCALAR 0
+#define KERNEL_SSE2 1
+#define KERNEL_AVX2 2
+
+/* ScanKernels holds the kernels getToken uses for
+ * long runs of characters. Each takes the current
+ * position p and the end of the buffer and returns
+ * the first position not in the run
+ */
+typedef struct scanKernels
+{
+  /* skipSpace skips ' ', '\t', '\n' and '\r',
+   * storing in *lines the number of '\n' skipped
+   */
+  const unsigned char *(*skipSpace)(const unsigned char *p, const unsigned char *end, int *lines);
+  /* commentEnd finds the "*" of the next "*" "/" pair,
+   * or end, storing in *lines the number of '\n' before it
+   */
+  const unsigned char *(*commentEnd)(const unsigned char *p, const unsigned char *end, int *lines);
+  /* letterRun skips letters a-z, A-Z */
+  const unsigned char *(*letterRun)(const unsigned char *p, const unsigned char *end);
+  /* digitRun skips digits 0-9 */
+  const unsigned char *(*digitRun)(const unsigned char *p, const unsigned char *end);
+  int level; /* one of the KERNEL_ levels */
+} ScanKernels;
+
+/* Function selectScanKernels returns the best vector
+ * kernels the running CPU supports, but no better than
+ * maxLevel; NULL if there are none
+ */
+const ScanKernels *selectScanKernels(int maxLevel);
+
+/* the character classes the vector kernels assume */
+#define KERNEL_CC_OTHER 0
+#define KERNEL_CC_SPACE 1
+#define KERNEL_CC_LETTER 2
+#define KERNEL_CC_DIGIT 3
+
+/* Function kernelCharClass returns the KERNEL_CC_
+ * class the vector kernels give character c
+ */
+int kernelCharClass(int c);
+
+/* Procedure addToRun adds d to each of the n words
+ * at a, and addToOffsets to each of the n offsets;
+ * relexEdit moves the lines and offsets of the
+ * tokens after an edit with them
+ */
+void addToRun(unsigned int *a, int n, int d);
+void addToOffsets(size_t *a, int n, long d);
+
+#endif
@@ -8,108 +8,151 @@
 
 #include "util.h"
 #include "globals.h"
+#include "arena.h"
+#include "scan.h"
+#include "writer.h"
 
-/* Procedure printToken prints a token
- * and its lexeme to the listing file
+/* allocate and set tracing flags */
+int EchoSource = FALSE;
+int TraceScan = FALSE;
+int TraceParse = TRUE;
+int TraceAnalyze = FALSE;
+int TraceCode = FALSE;
+
+CompileContext *newCompileContext(FILE *source, FILE *listing)
+{
+  CompileContext *cx = (CompileContext *)calloc(1, sizeof(CompileContext));
+  if (cx != NULL)
+  {
+    cx->symbols = (InternTable *)calloc(1, sizeof(InternTable));
+    /* every TreeNode and Array of the syntax tree is
+       carved from cx->nodes */
+    cx->nodes = (Arena *)calloc(1, sizeof(Arena));
+    if (cx->symbols == NULL || cx->nodes == NULL)
+    {
+      free(cx->symbols);
+      free(cx->nodes);
+      free(cx);
+      return NULL;
+    }
+    cx->source = source;
+    cx->listing = listing;
+  }
+  return cx;
+}
+
+void resetCompileContext(CompileContext *cx, FILE *source, FILE *listing)
+{
+  releaseSource(cx);
+  clearTokenTable(cx);
+  arenaReset(cx->nodes);
+  clearInternTable(cx->symbols);
+  cx->source = source;
+  cx->listing = listing;
+  cx->lineno = 0;
+  cx->Error = FALSE;
+  cx->errorCount = cx->errorLine = 0;
+  cx->indentno = 0;
+}
+
+void freeCompileContext(CompileContext *cx)
+{
+  if (cx == NULL)
+    return;
+  releaseSource(cx);
+  destroyTokenTable(cx);
+  releaseSyntaxTree(cx);
+  destroyInternTable(cx->symbols);
+  free(cx->symbols);
+  free(cx->nodes);
+  free(cx);
+}
+
+/* Function spellToken writes the line printToken
+ * prints for token and its lexeme into buf, of size
+ * bytes, and returns its length as snprintf does
  */
-void printToken(TokenType token, const char *tokenString)
+int spellToken(char *buf, int size, TokenType token, const char *tokenString)
 {
   switch (token)
   {
-  case IF:
-  case ELSE:
-  case WHILE:
-  case RETURN:
-  case VOID:
-  case INT:
-    fprintf(listing, "reserved word: %s\n", tokenString);
-    break;
+#define KEYWORD(str, tok) case tok:
+#include "keywords.def"
+#undef KEYWORD
+    return snprintf(buf, size, "reserved word: %s\n", tokenString);
   case ASSIGN:
-    fprintf(listing, "=\n");
-    break;
+    return snprintf(buf, size, "=\n");
   case LT:
-    fprintf(listing, "<\n");
-    break;
+    return snprintf(buf, size, "<\n");
   case LE:
-    fprintf(listing, "<=\n");
-    break;
+    return snprintf(buf, size, "<=\n");
   case GE:
-    fprintf(listing, ">=\n");
-    break;
+    return snprintf(buf, size, ">=\n");
   case GT:
-    fprintf(listing, ">\n");
-    break;
+    return snprintf(buf, size, ">\n");
   case LBRACE:
-    fprintf(listing, "{\n");
-    break;
+    return snprintf(buf, size, "{\n");
   case RBRACE:
-    fprintf(listing, "}\n");
-    break;
+    return snprintf(buf, size, "}\n");
   case LBRACKET:
-    fprintf(listing, "[\n");
-    break;
+    return snprintf(buf, size, "[\n");
   case RBRACKET:
-    fprintf(listing, "]\n");
-    break;
+    return snprintf(buf, size, "]\n");
   case COMMA:
-    fprintf(listing, ",\n");
-    break;
+    return snprintf(buf, size, ",\n");
   case EQ:
-    fprintf(listing, "==\n");
-    break;
+    return snprintf(buf, size, "==\n");
   case LPAREN:
-    fprintf(listing, "(\n");
-    break;
+    return snprintf(buf, size, "(\n");
   case RPAREN:
-    fprintf(listing, ")\n");
-    break;
+    return snprintf(buf, size, ")\n");
   case SEMI:
-    fprintf(listing, ";\n");
-    break;
+    return snprintf(buf, size, ";\n");
   case PLUS:
-    fprintf(listing, "+\n");
-    break;
+    return snprintf(buf, size, "+\n");
   case SUB:
-    fprintf(listing, "-\n");
-    break;
+    return snprintf(buf, size, "-\n");
   case MUL:
-    fprintf(listing, "*\n");
-    break;
+    return snprintf(buf, size, "*\n");
   case DIV:
-    fprintf(listing, "/\n");
-    break;
+    return snprintf(buf, size, "/\n");
   case ENDFILE:
-    fprintf(listing, "EOF\n");
-    break;
+    return snprintf(buf, size, "EOF\n");
   case NUM:
-    fprintf(listing, "NUM, val= %s\n", tokenString);
-    break;
+    return snprintf(buf, size, "NUM, val= %s\n", tokenString);
   case ID:
-    fprintf(listing, "ID, name= %s\n", tokenString);
-    break;
+    return snprintf(buf, size, "ID, name= %s\n", tokenString);
   case ERROR:
-    fprintf(listing, "ERROR: %s\n", tokenString);
-    break;
+    return snprintf(buf, size, "ERROR: %s\n", tokenString);
   case ERRORENDFILE:
-    fprintf(listing, "ERROR: comment is not closed!\n");
-    break;
+    return snprintf(buf, size, "ERROR: comment is not closed!\n");
   default: /* should never happen */
-    fprintf(listing, "Unknown token: %d\n", token);
+    return snprintf(buf, size, "Unknown token: %d\n", token);
   }
 }
 
+/* Procedure printToken prints a token
+ * and its lexeme to the listing file
+ */
+void printToken(CompileContext *cx, TokenType token, const char *tokenString)
+{
+  char line[MAXTOKENLEN + 32];
+  spellToken(line, sizeof(line), token, tokenString);
+  fputs(line, cx->listing);
+}
+
 /* Function newStmtNode creates a new statement
  * node for syntax tree construction
  */
 
 // todo: 创建新的声明节点
-TreeNode *newDclrNode(DclrKind kind, TypeSpecifier type, char *idName, int len, TreeNode *prms, TreeNode *CompoundStmt, int lineNo)
+TreeNode *newDclrNode(CompileContext *cx, DclrKind kind, TypeSpecifier type, int idName, int len, TreeNode *prms, TreeNode *CompoundStmt, int lineNo)
 {
-  TreeNode *t = (TreeNode *)malloc(sizeof(TreeNode));
+  TreeNode *t = (TreeNode *)arenaAlloc(cx->nodes, sizeof(TreeNode));
   int i;
   if (t == NULL)
   {
-    fprintf(listing, "Out of memeory error at line %d\n", lineNo);
+    fprintf(stderr, "Out of memeory error at line %d\n", lineNo);
   }
   else
   {
@@ -128,9 +171,14 @@ TreeNode *newDclrNode(DclrKind kind, TypeSpecifier type, char *idName, int len,
     }
     else if (kind == VarArrK)
     {
-      t->attr.arr = (Array *)malloc(sizeof(Array));
-      strcpy(t->attr.arr->name, idName);
-      t->attr.arr->len = len;
+      t->attr.arr = (Array *)arenaAlloc(cx->nodes, sizeof(Array));
+      if (t->attr.arr == NULL)
+        fprintf(stderr, "Out of memory error at line %d\n", lineNo);
+      else
+      {
+        t->attr.arr->name = idName;
+        t->attr.arr->len = len;
+      }
     }
     else if (kind == FunK)
     {
@@ -142,12 +190,12 @@ TreeNode *newDclrNode(DclrKind kind, TypeSpecifier type, char *idName, int len,
   return t;
 }
 
-TreeNode *newStmtNode(StmtKind kind, int lineNo)
+TreeNode *newStmtNode(CompileContext *cx, StmtKind kind, int lineNo)
 {
-  TreeNode *t = (TreeNode *)malloc(sizeof(TreeNode));
+  TreeNode *t = (TreeNode *)arenaAlloc(cx->nodes, sizeof(TreeNode));
   int i;
   if (t == NULL)
-    fprintf(listing, "Out of memory error at line %d\n", lineNo);
+    fprintf(stderr, "Out of memory error at line %d\n", lineNo);
   else
   {
     for (i = 0; i < MAXCHILDREN; i++)
@@ -163,12 +211,12 @@ TreeNode *newStmtNode(StmtKind kind, int lineNo)
 /* Function newExpNode creates a new expression
  * node for syntax tree construction
  */
-TreeNode *newExpNode(ExpKind kind, TypeSpecifier type, int lineNo)
+TreeNode *newExpNode(CompileContext *cx, ExpKind kind, TypeSpecifier type, int lineNo)
 {
-  TreeNode *t = (TreeNode *)malloc(sizeof(TreeNode));
+  TreeNode *t = (TreeNode *)arenaAlloc(cx->nodes, sizeof(TreeNode));
   int i;
   if (t == NULL)
-    fprintf(listing, "Out of memory error at line %d\n", lineNo);
+    fprintf(stderr, "Out of memory error at line %d\n", lineNo);
   else
   {
     for (i = 0; i < MAXCHILDREN; i++)
@@ -196,188 +244,29 @@ char *copyString(char *s)
   n = strlen(s) + 1;
   t = (char *)malloc(n);
   if (t == NULL)
-    fprintf(listing, "Out of memory error at line %d\n", lineno);
+    fprintf(stderr, "Out of memory error copying a string\n");
   else
     strcpy(t, s);
   return t;
 }
 
-/* Variable indentno is used by printTree to
- * store current number of spaces to indent
+/* procedure printTree prints a syntax tree to the
+ * listing file using indentation to indicate subtrees;
+ * it is rendered by a TreeWriter, see writer.h
  */
-static int indentno = 0;
-
-/* macros to increase/decrease indentation */
-#define INDENT indentno += 2
-#define UNINDENT indentno -= 2
-
-/* printSpaces indents by printing spaces */
-static void printSpaces(void)
+void printTree(CompileContext *cx, TreeNode *tree)
 {
-  int i;
-  for (i = 0; i < indentno; i++)
-    fprintf(listing, " ");
+  TreeWriter w;
+  startTreeWriter(&w, cx->listing, TextTree, cx->symbols);
+  w.indent = cx->indentno;
+  writeTree(&w, tree);
+  endTreeWriter(&w);
 }
 
-/* procedure printTree prints a syntax tree to the
- * listing file using indentation to indicate subtrees
+/* Procedure releaseSyntaxTree frees every node
+ * made by the node constructors
  */
-void printTree(TreeNode *tree)
+void releaseSyntaxTree(CompileContext *cx)
 {
-  int i;
-  INDENT;
-  while (tree != NULL)
-  {
-    printSpaces();
-    if (tree->nodekind == StmtK)
-    {
-      switch (tree->kind.stmt)
-      {
-      case SelectionK:
-        fprintf(listing, "if:\n");
-        INDENT;
-        printSpaces();
-        fprintf(listing, "Condition:\n");
-        printTree(tree->child[0]);
-        printSpaces();
-        fprintf(listing, "Body:\n");
-        if(tree->child[1]->kind.stmt == CompoundK){
-          printTree(tree->child[1]->child[0]);
-          printTree(tree->child[1]->child[1]);
-        } else {
-          printTree(tree->child[1]);
-          printSpaces();
-          fprintf(listing, "Else body:\n");
-          printTree(tree->child[2]);
-        }
-        UNINDENT;
-        break;
-      case IterationK:
-        fprintf(listing, "while:\n");
-        INDENT;
-        printSpaces();
-        fprintf(listing, "Condition:\n");
-        printTree(tree->child[0]);
-        printSpaces();
-        fprintf(listing, "Body:\n");
-        printTree(tree->child[1]->child[0]);
-        printTree(tree->child[1]->child[1]);
-        UNINDENT;
-        break;
-      case ASSIGNK:
-        fprintf(listing, "assign:\n");
-        INDENT;
-        printTree(tree->child[0]);
-        printTree(tree->child[1]);
-        UNINDENT;
-        break;
-      case ReturnK:
-        fprintf(listing, "return:\n");
-        printTree(tree->child[0]);
-        break;
-      default:
-        fprintf(listing, "Unknown ExpNode kind\n");
-        break;
-      }
-    }
-    else if (tree->nodekind == ExpK)
-    {
-      switch (tree->kind.exp)
-      {
-      case OpK:
-        fprintf(listing, "Op: ");
-        printToken(tree->attr.op, "\0");
-        INDENT;
-        printTree(tree->child[0]);
-        printTree(tree->child[1]);
-        UNINDENT;
-        break;
-      case ConstK:
-        fprintf(listing, "Const: %d\n", tree->attr.val);
-        break;
-      case IdK:
-        fprintf(listing, "Id: %s\n", tree->attr.name);
-        break;
-      case IdArrK:
-        fprintf(listing, "Subscript: %s\n", tree->attr.arr->name);
-        INDENT;
-        printSpaces();
-        fprintf(listing, "Index:\n");
-        printTree(tree->child[0]);
-        UNINDENT;
-        break;
-      case CallK:
-        fprintf(listing, "Call: %s\n", tree->attr.name);
-        INDENT;
-        printSpaces();
-        fprintf(listing, "Args:\n");
-        printTree(tree->child[0]);
-        UNINDENT;
-        break;
-      default:
-        fprintf(listing, "Unknown ExpNode kind\n");
-        break;
-      }
-    }
-    else if (tree->nodekind == DclrK)
-    {
-      switch (tree->kind.dclr)
-      {
-      case VarK:
-        fprintf(listing, "Declare variable: %s\n", tree->attr.name);
-        break;
-      case VarArrK:
-        if (tree->attr.arr->len == 0)
-        {
-          fprintf(listing, "Declare array: %s[]\n", tree->attr.arr->name);
-        }
-        else
-        {
-          fprintf(listing, "Declare array: %s[%d]\n", tree->attr.arr->name, tree->attr.arr->len);
-        }
-        break;
-      case FunK:
-        fprintf(listing, "Declare function: %s\n", tree->attr.name);
-        INDENT;
-        printSpaces();
-        fprintf(listing, "params:\n");
-        printTree(tree->child[0]);
-        printSpaces();
-        fprintf(listing, "Function Body:\n");
-        printTree(tree->child[1]->child[0]);
-        printTree(tree->child[1]->child[1]);
-        UNINDENT;
-        break;
-      }
-    }
-    else
-    {
-      fprintf(listing, "Unknown node kind\n");
-    }
-    tree = tree->sibling;
-  }
-  UNINDENT;
+  arenaRelease(cx->nodes);
 }
-
-void destroySyntaxTree(TreeNode *tree){
-  while(tree != NULL) {
-    int i;
-    for(i = 0; i < MAXCHILDREN; i++) {
-      destroySyntaxTree(tree->child[i]);
-    }
-    switch(tree->nodekind){
-      case ExpK:
-      break;
-      case StmtK:
-      break;
-      case DclrK:
-      if(tree->kind.dclr == VarArrK){
-        free(tree->attr.arr);
-      }
-      break;
-      default:
-      break;
-    }
-    tree = tree->sibling;
-  }
-}
\ No newline at end of file
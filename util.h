@@ -8,24 +8,45 @@
 #ifndef _UTIL_H_
 #define _UTIL_H_
 #include "globals.h"
+#include "intern.h"
 
 
+/* Function newCompileContext returns a context for
+ * compiling source into listing, NULL if out of
+ * memory; freeCompileContext frees it and all it
+ * holds but the two files
+ */
+CompileContext *newCompileContext(FILE *source, FILE *listing);
+void freeCompileContext(CompileContext *cx);
+
+/* Procedure resetCompileContext readies cx for
+ * compiling another source into listing, keeping
+ * the memory of its tokens, names and nodes
+ */
+void resetCompileContext(CompileContext *cx, FILE *source, FILE *listing);
+
 /* Procedure printToken prints a token 
  * and its lexeme to the listing file
  */
-void printToken(TokenType, const char *);
+void printToken(CompileContext *, TokenType, const char *);
 
-TreeNode *newDclrNode(DclrKind kind, TypeSpecifier type, char* idName, int arrLen, TreeNode* prms, TreeNode* compoundStmt, int);
+/* Function spellToken writes the line printToken
+ * prints into buf, of size bytes, and returns its
+ * length as snprintf does
+ */
+int spellToken(char *buf, int size, TokenType token, const char *tokenString);
+
+TreeNode *newDclrNode(CompileContext *cx, DclrKind kind, TypeSpecifier type, int idName, int arrLen, TreeNode* prms, TreeNode* compoundStmt, int);
 
 /* Function newStmtNode creates a new statement
  * node for syntax tree construction
  */
-TreeNode *newStmtNode(StmtKind, int);
+TreeNode *newStmtNode(CompileContext *, StmtKind, int);
 
 /* Function newExpNode creates a new expression 
  * node for syntax tree construction
  */
-TreeNode *newExpNode(ExpKind, TypeSpecifier, int);
+TreeNode *newExpNode(CompileContext *, ExpKind, TypeSpecifier, int);
 
 /* Function copyString allocates and makes a new
  * copy of an existing string
@@ -35,8 +56,11 @@ char *copyString(char *);
 /* procedure printTree prints a syntax tree to the 
  * listing file using indentation to indicate subtrees
  */
-void printTree(TreeNode *);
+void printTree(CompileContext *, TreeNode *);
 
-void destroySyntaxTree(TreeNode *);
+/* Procedure releaseSyntaxTree frees every syntax
+ * tree of cx built so far in one go
+ */
+void releaseSyntaxTree(CompileContext *);
 
 #endif
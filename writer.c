@@ -0,0 +1,592 @@
+/****************************************************/
+/* File: writer.c                                   */
+/* Buffered syntax tree writer: the text listing,   */
+/* JSON and S-expressions                           */
+/****************************************************/
+
+#include "writer.h"
+#include "util.h"
+#include <pthread.h>
+
+/* WRITEBUF = bytes rendered before they are written */
+#define WRITEBUF (1 << 18)
+
+/* SPACES = longest indentation written in one piece */
+#define SPACES 256
+static char spaces[SPACES];
+
+/* opLine[t] is the "Op: " line of operator t in the
+   text format, as printToken spells it; opName[t] is
+   operator t in the other formats */
+#define OPLINE 32
+static char opLine[NTOKENTYPES][OPLINE];
+static int opLineLen[NTOKENTYPES];
+static const char *const opName[NTOKENTYPES] = {
+    [PLUS] = "+", [SUB] = "-", [MUL] = "*", [DIV] = "/",
+    [LT] = "<", [LE] = "<=", [GT] = ">", [GE] = ">=",
+    [EQ] = "==", [NE] = "!="};
+
+static pthread_once_t tablesMade = PTHREAD_ONCE_INIT;
+
+static void makeTables(void)
+{
+  int t;
+  memset(spaces, ' ', SPACES);
+  for (t = 0; t < NTOKENTYPES; t++)
+  {
+    memcpy(opLine[t], "Op: ", 4);
+    opLineLen[t] = 4 + spellToken(opLine[t] + 4, OPLINE - 4, (TokenType)t, "");
+    if (opLineLen[t] > OPLINE - 1)
+      opLineLen[t] = OPLINE - 1;
+  }
+}
+
+int treeFormatOf(const char *name, TreeFormat *format)
+{
+  if (strcmp(name, "text") == 0)
+    *format = TextTree;
+  else if (strcmp(name, "json") == 0)
+    *format = JsonTree;
+  else if (strcmp(name, "sexp") == 0)
+    *format = SexpTree;
+  else
+    return FALSE;
+  return TRUE;
+}
+
+void startTreeWriter(TreeWriter *w, FILE *out, TreeFormat format, const InternTable *symbols)
+{
+  pthread_once(&tablesMade, makeTables);
+  memset(w, 0, sizeof(TreeWriter));
+  w->out = out;
+  w->format = format;
+  w->symbols = symbols;
+  w->buf = (char *)malloc(WRITEBUF);
+  if (w->buf == NULL)
+  {
+    fprintf(stderr, "Out of memory error writing the tree\n");
+    exit(1);
+  }
+}
+
+void flushTreeWriter(TreeWriter *w)
+{
+  if (w->used > 0)
+    fwrite(w->buf, 1, w->used, w->out);
+  w->used = 0;
+}
+
+/* put adds the n characters of s */
+static void put(TreeWriter *w, const char *s, int n)
+{
+  if (w->used + n > WRITEBUF)
+  {
+    flushTreeWriter(w);
+    if (n > WRITEBUF)
+    {
+      fwrite(s, 1, n, w->out);
+      return;
+    }
+  }
+  memcpy(w->buf + w->used, s, n);
+  w->used += n;
+}
+
+/* PUTS adds a string constant */
+#define PUTS(w, s) put(w, s, sizeof(s) - 1)
+
+static void putString(TreeWriter *w, const char *s)
+{
+  put(w, s, (int)strlen(s));
+}
+
+static void putInt(TreeWriter *w, int v)
+{
+  char digits[12];
+  int i = sizeof(digits);
+  unsigned int u = v < 0 ? 0u - (unsigned int)v : (unsigned int)v;
+  do
+  {
+    digits[--i] = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (v < 0)
+    digits[--i] = '-';
+  put(w, digits + i, (int)sizeof(digits) - i);
+}
+
+static void putSpaces(TreeWriter *w, int n)
+{
+  for (; n > SPACES; n -= SPACES)
+    put(w, spaces, SPACES);
+  put(w, spaces, n);
+}
+
+/**************************************************/
+/***********   the text format          ************/
+/**************************************************/
+
+/* putName adds symbol id as printf's %s would */
+static void putName(TreeWriter *w, int id)
+{
+  const char *s = symbolName(w->symbols, id);
+  putString(w, s != NULL ? s : "(null)");
+}
+
+/* a WriteStep is one step of the walk of a tree:
+ * writing the nodes of list t, a label line s, a
+ * node t alone, the items of list t, a string s or
+ * the start of field s. indent is that of the text
+ * format
+ */
+typedef enum
+{
+  ListStep,
+  LabelStep,
+  NodeStep,
+  ItemsStep,
+  StringStep,
+  FieldStep
+} StepKind;
+
+typedef struct writeStep
+{
+  StepKind what;
+  int indent;
+  TreeNode *t;
+  const char *s;
+} WriteStep;
+
+/* pushStep adds a step to be taken before those
+   already pushed */
+static void pushStep(TreeWriter *w, StepKind what, int indent, TreeNode *t, const char *s)
+{
+  WriteStep *st;
+  if (w->stepTop == w->stepCapacity)
+  {
+    w->stepCapacity = w->stepCapacity ? 2 * w->stepCapacity : 256;
+    w->steps = (WriteStep *)realloc(w->steps, w->stepCapacity * sizeof(WriteStep));
+    if (w->steps == NULL)
+    {
+      fprintf(stderr, "Out of memory error writing the tree\n");
+      exit(1);
+    }
+  }
+  st = &w->steps[w->stepTop++];
+  st->what = what;
+  st->indent = indent;
+  st->t = t;
+  st->s = s;
+}
+
+/* pushList pushes the list t to be written at indent;
+   pushBody the declarations and statements of a
+   compound statement, one level in. A body lost to a
+   syntax error is NULL and writes nothing */
+static void pushList(TreeWriter *w, TreeNode *t, int indent)
+{
+  if (t != NULL)
+    pushStep(w, ListStep, indent, t, NULL);
+}
+
+static void pushBody(TreeWriter *w, TreeNode *body, int indent)
+{
+  if (body != NULL)
+  {
+    pushList(w, body->child[1], indent + 2);
+    pushList(w, body->child[0], indent + 2);
+  }
+}
+
+static void pushLabel(TreeWriter *w, const char *label, int indent)
+{
+  pushStep(w, LabelStep, indent, NULL, label);
+}
+
+/* writeTextNode writes the line of tree at indent and
+   pushes what comes under it, the last part first */
+static void writeTextNode(TreeWriter *w, TreeNode *tree, int indent)
+{
+  putSpaces(w, indent);
+  if (tree->nodekind == StmtK)
+  {
+    switch (tree->kind.stmt)
+    {
+    case SelectionK:
+      PUTS(w, "if:\n");
+      if (tree->child[1] == NULL || tree->child[1]->kind.stmt == CompoundK)
+        pushBody(w, tree->child[1], indent + 2);
+      else
+      {
+        pushList(w, tree->child[2], indent + 4);
+        pushLabel(w, "Else body:\n", indent + 2);
+        pushList(w, tree->child[1], indent + 4);
+      }
+      pushLabel(w, "Body:\n", indent + 2);
+      pushList(w, tree->child[0], indent + 4);
+      pushLabel(w, "Condition:\n", indent + 2);
+      break;
+    case IterationK:
+      PUTS(w, "while:\n");
+      pushBody(w, tree->child[1], indent + 2);
+      pushLabel(w, "Body:\n", indent + 2);
+      pushList(w, tree->child[0], indent + 4);
+      pushLabel(w, "Condition:\n", indent + 2);
+      break;
+    case ASSIGNK:
+      PUTS(w, "assign:\n");
+      pushList(w, tree->child[1], indent + 4);
+      pushList(w, tree->child[0], indent + 4);
+      break;
+    case ReturnK:
+      PUTS(w, "return:\n");
+      pushList(w, tree->child[0], indent + 2);
+      break;
+    default:
+      PUTS(w, "Unknown ExpNode kind\n");
+      break;
+    }
+  }
+  else if (tree->nodekind == ExpK)
+  {
+    switch (tree->kind.exp)
+    {
+    case OpK:
+      put(w, opLine[tree->attr.op], opLineLen[tree->attr.op]);
+      pushList(w, tree->child[1], indent + 4);
+      pushList(w, tree->child[0], indent + 4);
+      break;
+    case ConstK:
+      PUTS(w, "Const: ");
+      putInt(w, tree->attr.val);
+      PUTS(w, "\n");
+      break;
+    case IdK:
+      PUTS(w, "Id: ");
+      putName(w, tree->attr.name);
+      PUTS(w, "\n");
+      break;
+    case IdArrK:
+      PUTS(w, "Subscript: ");
+      putName(w, tree->attr.name);
+      PUTS(w, "\n");
+      pushList(w, tree->child[0], indent + 4);
+      pushLabel(w, "Index:\n", indent + 2);
+      break;
+    case CallK:
+      PUTS(w, "Call: ");
+      putName(w, tree->attr.name);
+      PUTS(w, "\n");
+      pushList(w, tree->child[0], indent + 4);
+      pushLabel(w, "Args:\n", indent + 2);
+      break;
+    default:
+      PUTS(w, "Unknown ExpNode kind\n");
+      break;
+    }
+  }
+  else if (tree->nodekind == DclrK)
+  {
+    switch (tree->kind.dclr)
+    {
+    case VarK:
+      PUTS(w, "Declare variable: ");
+      putName(w, tree->attr.name);
+      PUTS(w, "\n");
+      break;
+    case VarArrK:
+      PUTS(w, "Declare array: ");
+      putName(w, tree->attr.arr->name);
+      PUTS(w, "[");
+      if (tree->attr.arr->len != 0)
+        putInt(w, (int)tree->attr.arr->len);
+      PUTS(w, "]\n");
+      break;
+    case FunK:
+      PUTS(w, "Declare function: ");
+      putName(w, tree->attr.name);
+      PUTS(w, "\n");
+      pushBody(w, tree->child[1], indent + 2);
+      pushLabel(w, "Function Body:\n", indent + 2);
+      pushList(w, tree->child[0], indent + 4);
+      pushLabel(w, "params:\n", indent + 2);
+      break;
+    }
+  }
+  else
+    PUTS(w, "Unknown node kind\n");
+}
+
+/* writeText writes a list of nodes as printTree
+   always has, one more level in */
+static void writeText(TreeWriter *w, TreeNode *tree)
+{
+  int base = w->stepTop;
+  WriteStep st;
+  pushList(w, tree, w->indent + 2);
+  while (w->stepTop > base)
+  {
+    st = w->steps[--w->stepTop];
+    if (st.what == LabelStep)
+    {
+      putSpaces(w, st.indent);
+      putString(w, st.s);
+      continue;
+    }
+    /* the rest of the list comes after tree and all
+       that is under it */
+    pushList(w, st.t->sibling, st.indent);
+    writeTextNode(w, st.t, st.indent);
+  }
+}
+
+/**************************************************/
+/***********   JSON and S-expressions   ************/
+/**************************************************/
+
+/* the other formats share one walk: a node is its
+   kind followed by its fields, each a value, a node
+   or a list of nodes. JSON names the fields, an
+   S-expression only lists them in order. The
+   fields that are nodes or lists come last; they
+   are pushed as steps of the walk, the last first */
+
+/* field starts field name of a node */
+static void field(TreeWriter *w, const char *name)
+{
+  if (w->format == JsonTree)
+  {
+    PUTS(w, ",\"");
+    putString(w, name);
+    PUTS(w, "\":");
+  }
+  else
+    PUTS(w, " ");
+}
+
+static void nameField(TreeWriter *w, const char *name, int id)
+{
+  const char *s = symbolName(w->symbols, id);
+  field(w, name);
+  if (s == NULL)
+    putString(w, w->format == JsonTree ? "null" : "nil");
+  else if (w->format == JsonTree)
+  {
+    PUTS(w, "\"");
+    putString(w, s);
+    PUTS(w, "\"");
+  }
+  else
+    putString(w, s);
+}
+
+static void intField(TreeWriter *w, const char *name, int v)
+{
+  field(w, name);
+  putInt(w, v);
+}
+
+static void typeField(TreeWriter *w, TypeSpecifier type)
+{
+  field(w, "type");
+  if (w->format == JsonTree)
+    putString(w, type == Void ? "\"void\"" : "\"int\"");
+  else
+    putString(w, type == Void ? "void" : "int");
+}
+
+static void nodeField(TreeWriter *w, const char *name, TreeNode *t)
+{
+  pushStep(w, NodeStep, 0, t, NULL);
+  pushStep(w, FieldStep, 0, NULL, name);
+}
+
+static void listField(TreeWriter *w, const char *name, TreeNode *t)
+{
+  pushStep(w, StringStep, 0, NULL, w->format == JsonTree ? "]" : ")");
+  if (t != NULL)
+    pushStep(w, ItemsStep, 0, t, NULL);
+  pushStep(w, StringStep, 0, NULL, w->format == JsonTree ? "[" : "(");
+  pushStep(w, FieldStep, 0, NULL, name);
+}
+
+/* writeNodeStep writes the kind and the value fields
+   of t and pushes the rest of it */
+static void writeNodeStep(TreeWriter *w, TreeNode *t)
+{
+  const char *kind = "unknown";
+  if (t == NULL)
+  {
+    putString(w, w->format == JsonTree ? "null" : "nil");
+    return;
+  }
+  if (t->nodekind == DclrK)
+    kind = t->kind.dclr == VarK ? "var" : t->kind.dclr == VarArrK ? "array" : t->kind.dclr == FunK ? "function" : kind;
+  else if (t->nodekind == StmtK)
+    switch (t->kind.stmt)
+    {
+    case ASSIGNK: kind = "assign"; break;
+    case CompoundK: kind = "compound"; break;
+    case SelectionK: kind = "if"; break;
+    case IterationK: kind = "while"; break;
+    case ReturnK: kind = "return"; break;
+    }
+  else if (t->nodekind == ExpK)
+    switch (t->kind.exp)
+    {
+    case OpK: kind = "op"; break;
+    case ConstK: kind = "const"; break;
+    case IdArrK: kind = "subscript"; break;
+    case CallK: kind = "call"; break;
+    case IdK: kind = "id"; break;
+    }
+  if (w->format == JsonTree)
+  {
+    PUTS(w, "{\"node\":\"");
+    putString(w, kind);
+    PUTS(w, "\",\"line\":");
+    putInt(w, t->lineno);
+  }
+  else
+  {
+    PUTS(w, "(");
+    putString(w, kind);
+  }
+  pushStep(w, StringStep, 0, NULL, w->format == JsonTree ? "}" : ")");
+  if (t->nodekind == DclrK)
+    switch (t->kind.dclr)
+    {
+    case VarK:
+      typeField(w, t->type);
+      nameField(w, "name", t->attr.name);
+      break;
+    case VarArrK:
+      typeField(w, t->type);
+      nameField(w, "name", t->attr.arr->name);
+      if (t->attr.arr->len != 0)
+        intField(w, "size", (int)t->attr.arr->len);
+      break;
+    case FunK:
+      typeField(w, t->type);
+      nameField(w, "name", t->attr.name);
+      nodeField(w, "body", t->child[1]);
+      listField(w, "params", t->child[0]);
+      break;
+    }
+  else if (t->nodekind == StmtK)
+    switch (t->kind.stmt)
+    {
+    case ASSIGNK:
+      nodeField(w, "value", t->child[1]);
+      nodeField(w, "target", t->child[0]);
+      break;
+    case CompoundK:
+      listField(w, "statements", t->child[1]);
+      listField(w, "locals", t->child[0]);
+      break;
+    case SelectionK:
+      nodeField(w, "else", t->child[2]);
+      nodeField(w, "then", t->child[1]);
+      nodeField(w, "condition", t->child[0]);
+      break;
+    case IterationK:
+      nodeField(w, "body", t->child[1]);
+      nodeField(w, "condition", t->child[0]);
+      break;
+    case ReturnK:
+      nodeField(w, "value", t->child[0]);
+      break;
+    }
+  else if (t->nodekind == ExpK)
+    switch (t->kind.exp)
+    {
+    case OpK:
+      field(w, "op");
+      if (w->format == JsonTree)
+        PUTS(w, "\"");
+      putString(w, opName[t->attr.op] != NULL ? opName[t->attr.op] : "?");
+      if (w->format == JsonTree)
+        PUTS(w, "\"");
+      nodeField(w, "right", t->child[1]);
+      nodeField(w, "left", t->child[0]);
+      break;
+    case ConstK:
+      intField(w, "value", t->attr.val);
+      break;
+    case IdK:
+      nameField(w, "name", t->attr.name);
+      break;
+    case IdArrK:
+      nameField(w, "name", t->attr.name);
+      nodeField(w, "index", t->child[0]);
+      break;
+    case CallK:
+      nameField(w, "name", t->attr.name);
+      listField(w, "args", t->child[0]);
+      break;
+    }
+}
+
+/* writeNode writes t alone, not its siblings */
+static void writeNode(TreeWriter *w, TreeNode *t)
+{
+  int base = w->stepTop;
+  WriteStep st;
+  pushStep(w, NodeStep, 0, t, NULL);
+  while (w->stepTop > base)
+  {
+    st = w->steps[--w->stepTop];
+    switch (st.what)
+    {
+    case NodeStep:
+      writeNodeStep(w, st.t);
+      break;
+    case ItemsStep:
+      if (st.t->sibling != NULL)
+      {
+        pushStep(w, ItemsStep, 0, st.t->sibling, NULL);
+        pushStep(w, StringStep, 0, NULL, w->format == JsonTree ? "," : " ");
+      }
+      pushStep(w, NodeStep, 0, st.t, NULL);
+      break;
+    case StringStep:
+      putString(w, st.s);
+      break;
+    case FieldStep:
+      field(w, st.s);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+void writeTree(TreeWriter *w, TreeNode *tree)
+{
+  if (w->format == TextTree)
+  {
+    writeText(w, tree);
+    return;
+  }
+  for (; tree != NULL; tree = tree->sibling)
+  {
+    if (w->format == JsonTree)
+      putString(w, w->count == 0 ? "[\n" : ",\n");
+    writeNode(w, tree);
+    if (w->format == SexpTree)
+      PUTS(w, "\n");
+    w->count++;
+  }
+}
+
+void endTreeWriter(TreeWriter *w)
+{
+  if (w->format == JsonTree)
+    putString(w, w->count == 0 ? "[]\n" : "\n]\n");
+  flushTreeWriter(w);
+  free(w->buf);
+  free(w->steps);
+  w->buf = NULL;
+  w->steps = NULL;
+  w->stepTop = w->stepCapacity = 0;
+}
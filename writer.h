@@ -0,0 +1,76 @@
+/****************************************************/
+/* File: writer.h                                   */
+/* Buffered syntax tree writer: the text listing,   */
+/* JSON and S-expressions                           */
+/****************************************************/
+
+#ifndef _WRITER_H_
+#define _WRITER_H_
+#include "globals.h"
+#include "intern.h"
+
+/* TreeFormat is how a TreeWriter writes a tree:
+ *
+ *   TextTree  the listing printTree has always made
+ *   JsonTree  a JSON array of the top-level
+ *             declarations, one per line; every node
+ *             is an object with "node" and "line"
+ *   SexpTree  one S-expression per declaration and
+ *             line, (node fields...), nil for a part
+ *             lost to a syntax error
+ */
+typedef enum
+{
+  TextTree,
+  JsonTree,
+  SexpTree
+} TreeFormat;
+
+/* a TreeWriter renders trees into a large buffer that
+ * goes to out in a few big writes, once it is full and
+ * when the writer is flushed or ended
+ */
+typedef struct treeWriter
+{
+  FILE *out;
+  TreeFormat format;
+  const InternTable *symbols; /* the names of the trees */
+  char *buf;
+  int used;
+  int indent; /* of the text format, as cx->indentno */
+  int count;  /* top-level declarations written */
+  /* the steps of the walk still to be taken: trees
+     are walked with this stack, not the C stack, so
+     nesting is not limited by it */
+  struct writeStep *steps;
+  int stepTop, stepCapacity;
+} TreeWriter;
+
+/* Function treeFormatOf sets *format to the format
+ * named text, json or sexp; FALSE for any other name
+ */
+int treeFormatOf(const char *name, TreeFormat *format);
+
+/* Procedure startTreeWriter readies w to write trees
+ * whose names are in symbols to out in format
+ */
+void startTreeWriter(TreeWriter *w, FILE *out, TreeFormat format, const InternTable *symbols);
+
+/* Procedure writeTree writes tree and its siblings,
+ * as top-level declarations following any written
+ * before
+ */
+void writeTree(TreeWriter *w, TreeNode *tree);
+
+/* Procedure flushTreeWriter hands what w holds to
+ * its FILE, so that what is printed there next comes
+ * after it
+ */
+void flushTreeWriter(TreeWriter *w);
+
+/* Procedure endTreeWriter ends the output of w,
+ * flushes it and frees its buffer
+ */
+void endTreeWriter(TreeWriter *w);
+
+#endif